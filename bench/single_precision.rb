@@ -0,0 +1,52 @@
+# frozen_string_literal: true
+
+# Measure training time, peak memory, and accuracy of the current build.
+# Run it once with the default build and once with the extension built with
+# --enable-single-precision, then compare the outputs:
+#
+#   $ bundle exec rake compile
+#   $ bundle exec ruby -Ilib bench/single_precision.rb
+#   $ bundle exec rake clobber compile -- --enable-single-precision
+#   $ bundle exec ruby -Ilib bench/single_precision.rb
+#
+# Usage: bench/single_precision.rb [n_samples] [n_features] [dtype (dfloat or sfloat)]
+
+require 'benchmark'
+require 'numo/libsvm'
+
+n_samples = (ARGV[0] || 10_000).to_i
+n_features = (ARGV[1] || 100).to_i
+klass = ARGV[2] == 'sfloat' ? Numo::SFloat : Numo::DFloat
+
+def peak_rss_mb
+  status = File.read('/proc/self/status')
+  status[/VmHWM:\s+(\d+)/, 1].to_i / 1024.0
+rescue Errno::ENOENT
+  Float::NAN
+end
+
+Numo::NArray.srand(1)
+w = Numo::DFloat.new(n_features).rand_norm
+x = klass.new(n_samples, n_features).rand_norm
+y = Numo::DFloat.cast(Numo::DFloat.cast(x).dot(w).gt(0)) * 2 - 1
+x_test = klass.new(n_samples / 5, n_features).rand_norm
+y_test = Numo::DFloat.cast(Numo::DFloat.cast(x_test).dot(w).gt(0)) * 2 - 1
+
+param = {
+  svm_type: Numo::Libsvm::SvmType::C_SVC,
+  kernel_type: Numo::Libsvm::KernelType::RBF,
+  gamma: 1.0 / n_features,
+  C: 1.0,
+  random_seed: 1
+}
+
+rss_before = peak_rss_mb
+model = nil
+train_time = Benchmark.realtime { model = Numo::Libsvm.train(x, y, param) }
+predicted = Numo::Libsvm.predict(Numo::DFloat.cast(x_test), param, model)
+accuracy = predicted.eq(y_test).count.fdiv(y_test.size)
+
+puts format('single_precision: %s, input: %s, n_samples: %d, n_features: %d',
+            Numo::Libsvm::SINGLE_PRECISION, klass, n_samples, n_features)
+puts format('train: %.3f s, peak RSS: %.1f MB (%.1f MB before training), support vectors: %d, accuracy: %.4f',
+            train_time, peak_rss_mb, rss_before, model[:l], accuracy)
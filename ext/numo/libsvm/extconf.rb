@@ -22,6 +22,19 @@ end
 
 abort 'libstdc++ is not found.' unless have_library('stdc++')
 
+if enable_config('openmp', true) && try_link('int main(void) { return 0; }', '-fopenmp')
+  $CXXFLAGS << ' -fopenmp'
+  $LDFLAGS << ' -fopenmp'
+end
+
+$defs << '-DLIBSVM_STRICT_LIBM' if enable_config('strict-libm', false)
+$defs << '-DLIBSVM_SINGLE_PRECISION' if enable_config('single-precision', false)
+
+if enable_config('sdt', false)
+  abort 'sys/sdt.h not found. Install systemtap-sdt-dev (or systemtap-sdt-devel).' unless have_header('sys/sdt.h')
+  $defs << '-DLIBSVM_SDT'
+end
+
 $srcs = Dir.glob("#{$srcdir}/**/*.cpp").map { |path| File.basename(path) }
 $INCFLAGS << " -I$(srcdir)/src"
 $VPATH << "$(srcdir)/src"
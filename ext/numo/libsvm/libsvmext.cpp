@@ -46,6 +46,8 @@ extern "C" void Init_libsvmext(void) {
 
   /* The version of LIBSVM used in backgroud library. */
   rb_define_const(mLibsvm, "LIBSVM_VERSION", INT2NUM(LIBSVM_VERSION));
+  /* Whether the values of samples and support vectors are stored in single precision (built with --enable-single-precision). */
+  rb_define_const(mLibsvm, "SINGLE_PRECISION", sizeof(svm_value) == sizeof(float) ? Qtrue : Qfalse);
 
   /**
    * Document-module: Numo::Libsvm::SvmType
@@ -79,11 +81,24 @@ extern "C" void Init_libsvmext(void) {
   /* Precomputed kernel */
   rb_define_const(mKernelType, "PRECOMPUTED", INT2NUM(PRECOMPUTED));
 
+  /**
+   * Document-module: Numo::Libsvm::SvPrecision
+   * The module consisting of constants for precision of support vectors that used for parameter of prediction.
+   */
+  VALUE mSvPrecision = rb_define_module_under(mLibsvm, "SvPrecision");
+  /* Double precision values (8 bytes per value) */
+  rb_define_const(mSvPrecision, "FLOAT64", INT2NUM(SV_FLOAT64));
+  /* Single precision values (4 bytes per value) */
+  rb_define_const(mSvPrecision, "FLOAT32", INT2NUM(SV_FLOAT32));
+  /* 8-bit integer values with per-feature scales (1 byte per value) */
+  rb_define_const(mSvPrecision, "INT8", INT2NUM(SV_INT8));
+
   /**
    * Train the SVM model according to the given training data.
    *
    * @overload train(x, y, param) -> Hash
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   *   @param x [Numo::DFloat/Numo::SFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   *     Numo::SFloat and Numo::Int32 arrays, and views such as slices and transposed arrays, are read without copying.
    *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
    *   @param param [Hash] The parameters of an SVM model.
    *
@@ -114,18 +129,57 @@ extern "C" void Init_libsvmext(void) {
    * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
    *   the sample array and label array do not have the same number of samples, or
    *   the hyperparameter has an invalid value, this error is raised.
-   * @return [Hash] The model obtained from the training procedure.
+   * @return [Hash] The model obtained from the training procedure. If the training stops at max_iter or max_time,
+   *   the model is the feasible solution found until then and its :converged is false.
+   *   If telemetry_interval or telemetry_callback is given in param, the model has :telemetry, the array of
+   *   the states of the solver sampled every telemetry_interval iterations (1000 by default) and at the end of
+   *   each solver of the decision functions (the solvers of the cross validation for probability estimates are not
+   *   sampled), with keys :subproblem, :iter, :obj, :kkt_violation, :active_size, :nr_shrink,
+   *   :nr_reconstruct, and :finished. telemetry_callback is called with each sample during training,
+   *   and an exception raised by it stops the training and is raised by train.
+   *   If kernel_stats is true in param, the model has :kernel_stats, the counters of the kernel cache and kernel
+   *   evaluations over all solvers with keys :cache_hits, :cache_misses, :cache_evictions, :cache_bytes (the peak
+   *   memory of cached kernel columns), :train_kernel_evaluations, :predict_kernel_evaluations (kernel values computed
+   *   for probability estimates), and :fill_time (seconds spent computing kernel columns).
+   *   If timing is true in param, the model has :timing, the seconds spent in converting the samples
+   *   (:convert_dataset), grouping them by class (:group_classes), cross validation for probability estimates
+   *   (:probability), the solvers (:solve), building the model (:assemble) and converting it into the hash
+   *   (:convert_model), with :pairs, the :probability and :solve seconds of each one-vs-one pair.
    */
   rb_define_module_function(mLibsvm, "train", RUBY_METHOD_FUNC(numo_libsvm_train), 3);
+  /**
+   * Start training the SVM model on a native thread, and return the handle of the training without waiting for it.
+   * The calling Ruby thread and other Ruby threads keep running while the model is trained.
+   * The training draws its random numbers from its own generator seeded with random_seed (or from rand when it
+   * is nil), and prints messages only if verbose is true, without changing the output of other trainings.
+   *
+   * @overload train_async(x, y, param) -> TrainingJob
+   *   @param x [Numo::DFloat/Numo::SFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The parameters of an SVM model.
+   *
+   * @example
+   *   job = Numo::Libsvm.train_async(x, y, param)
+   *   # prepare data for the next model here.
+   *   p job.progress unless job.done?
+   *   model = job.wait
+   *
+   * @raise [ArgumentError] Same as train, or if telemetry_callback is given.
+   * @return [TrainingJob] The handle of the training.
+   */
+  rb_define_module_function(mLibsvm, "train_async", RUBY_METHOD_FUNC(numo_libsvm_train_async), 3);
   /**
    * Perform cross validation under given parameters. The given samples are separated to n_fols folds.
    * The predicted labels or values in the validation process are returned.
    *
-   * @overload cv(x, y, param, n_folds) -> Numo::DFloat
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   * @overload cv(x, y, param, n_folds, timing: nil) -> Numo::DFloat
+   *   @param x [Numo::DFloat/Numo::SFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   *     Numo::SFloat and Numo::Int32 arrays, and views such as slices and transposed arrays, are read without copying.
    *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
    *   @param param [Hash] The parameters of an SVM model.
    *   @param n_folds [Integer] The number of folds.
+   *   @param timing [Hash] The hash to store the seconds spent in converting the samples (:convert_dataset),
+   *     grouping them by class (:group_classes), training (:train) and predicting (:predict) the folds.
    *
    * @example
    *   require 'numo/libsvm'
@@ -153,47 +207,129 @@ extern "C" void Init_libsvmext(void) {
    *
    * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
    *   the sample array and label array do not have the same number of samples, or
-   *   the hyperparameter has an invalid value, this error is raised.
+   *   the hyperparameter has an invalid value, or timing is not a hash, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
+   *   The samples of folds not trained because max_time ran out are NaN.
    */
-  rb_define_module_function(mLibsvm, "cv", RUBY_METHOD_FUNC(numo_libsvm_cross_validation), 4);
+  rb_define_module_function(mLibsvm, "cv", RUBY_METHOD_FUNC(numo_libsvm_cross_validation), -1);
   /**
    * Predict class labels or values for given samples.
    *
-   * @overload predict(x, param, model) -> Numo::DFloat
+   * Batches of fewer than 16 samples are predicted without compiling the model, unless sv_precision or
+   * tree_tolerance is given. Use CompiledModel to predict small batches repeatedly.
+   *
+   * @overload predict(x, param, model, out: nil, timing: nil) -> Numo::DFloat
    *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to calculate the scores.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
+   *   @param out [Numo::DFloat] (shape: [n_samples]) The array to store the results in, instead of a new array.
+   *   @param timing [Hash] The hash to store the seconds spent in converting (:convert_model) and compiling (:compile)
+   *     the model, converting the samples (:convert_samples) and computing the results (:predict).
    *
-   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the output array does not have
+   *   the shape of the results, or timing is not a hash, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
    */
-  rb_define_module_function(mLibsvm, "predict", RUBY_METHOD_FUNC(numo_libsvm_predict), 3);
+  rb_define_module_function(mLibsvm, "predict", RUBY_METHOD_FUNC(numo_libsvm_predict), -1);
   /**
    * Calculate decision values for given samples.
    *
-   * @overload decision_function(x, param, model) -> Numo::DFloat
+   * Batches of fewer than 16 samples are predicted without compiling the model, unless sv_precision or
+   * tree_tolerance is given. Use CompiledModel to predict small batches repeatedly.
+   *
+   * @overload decision_function(x, param, model, out: nil, timing: nil) -> Numo::DFloat
    *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to calculate the scores.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
+   *   @param out [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The array to store the results in,
+   *     instead of a new array.
+   *   @param timing [Hash] The hash to store the seconds spent in converting (:convert_model) and compiling (:compile)
+   *     the model, converting the samples (:convert_samples) and computing the results (:predict).
    *
-   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the output array does not have
+   *   the shape of the results, or timing is not a hash, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The decision value of each sample.
    */
-  rb_define_module_function(mLibsvm, "decision_function", RUBY_METHOD_FUNC(numo_libsvm_decision_function), 3);
+  rb_define_module_function(mLibsvm, "decision_function", RUBY_METHOD_FUNC(numo_libsvm_decision_function), -1);
   /**
    * Predict class probability for given samples. The model must have probability information calcualted in training procedure.
    * The parameter ':probability' set to 1 in training procedure.
    *
-   * @overload predict_proba(x, param, model) -> Numo::DFloat
+   * Batches of fewer than 16 samples are predicted without compiling the model, unless sv_precision or
+   * tree_tolerance is given. Use CompiledModel to predict small batches repeatedly.
+   *
+   * @overload predict_proba(x, param, model, out: nil, timing: nil) -> Numo::DFloat
    *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to predict the class probabilities.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
+   *   @param out [Numo::DFloat] (shape: [n_samples, n_classes]) The array to store the results in, instead of a new array.
+   *   @param timing [Hash] The hash to store the seconds spent in converting (:convert_model) and compiling (:compile)
+   *     the model, converting the samples (:convert_samples) and computing the results (:predict).
    *
-   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the output array does not have
+   *   the shape of the results, or timing is not a hash, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples, n_classes]) Predicted probablity of each class per sample.
    */
-  rb_define_module_function(mLibsvm, "predict_proba", RUBY_METHOD_FUNC(numo_libsvm_predict_proba), 3);
+  rb_define_module_function(mLibsvm, "predict_proba", RUBY_METHOD_FUNC(numo_libsvm_predict_proba), -1);
+  /**
+   * Predict class labels or values, decision values, and class probabilities for given samples at once.
+   * The kernel values of each sample are calculated only once.
+   *
+   * Batches of fewer than 16 samples are predicted without compiling the model, unless sv_precision or
+   * tree_tolerance is given. Use CompiledModel to predict small batches repeatedly.
+   *
+   * @overload predict_all(x, param, model) -> Array
+   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to be predicted.
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @return [Array<Numo::DFloat>] The predicted labels or values (same as predict), the decision values
+   *   (same as decision_function), and the class probabilities (same as predict_proba, nil if the model
+   *   does not have probability information).
+   */
+  rb_define_module_function(mLibsvm, "predict_all", RUBY_METHOD_FUNC(numo_libsvm_predict_all), 3);
+  /**
+   * Describe how the prediction functions evaluate the given model under the given parameters,
+   * e.g. whether the support vectors are folded into weight vectors or indexed by a ball tree.
+   *
+   * @overload compiled_model_info(param, model) -> Hash
+   *   @param param [Hash] The parameters of the trained SVM model, including the prediction options
+   *     early_termination, tree_tolerance, and sv_precision.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *
+   * @return [Hash] The hash with keys :weight_vector, :polynomial_map, :dense_sv, :early_termination,
+   *   :tree_nodes (the number of nodes of the ball tree over support vectors), :error_bound
+   *   (the bound of the error of decision values caused by tree_tolerance), :sv_precision,
+   *   :sv_bytes (the memory of the dense support vectors), :quantization_error
+   *   (the largest error of a support vector value caused by sv_precision), and :sv_node_bytes
+   *   (the memory of the sparse rows of support vectors, which are kept alongside the dense ones).
+   */
+  rb_define_module_function(mLibsvm, "compiled_model_info", RUBY_METHOD_FUNC(numo_libsvm_compiled_model_info), 2);
+  /**
+   * Compress the trained model into a smaller model with fewer support vectors.
+   * Support vectors with large coefficients are kept, and the coefficients are re-fitted
+   * so that each decision function is within the given tolerance of the original one
+   * in the feature space of the kernel. For the RBF kernel, the tolerance bounds
+   * the error of decision values.
+   *
+   * The compression runs without the GVL; an interrupt stops it at the support vectors added so far.
+   *
+   * @overload compress_model(param, model, tolerance, max_sv: nil, max_time: nil) -> Array
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *   @param tolerance [Float] The tolerance of the error of decision functions.
+   *   @param max_sv [Integer] The maximum number of support vectors kept in each decision function (nil for no limit).
+   *   @param max_time [Float] The time budget of the compression in seconds (nil for no limit).
+   *     Once it is spent, the decision functions keep the support vectors added so far, or all of them
+   *     if the refitting has not started.
+   *
+   * @raise [ArgumentError] If the tolerance, max_sv or max_time is negative or the model uses a precomputed kernel,
+   *   this error is raised.
+   * @return [Array] Array contains the compressed model and the hash with keys :error (the achieved error),
+   *   :l (the number of support vectors of the compressed model), and :original_l.
+   */
+  rb_define_module_function(mLibsvm, "compress_model", RUBY_METHOD_FUNC(numo_libsvm_compress_model), -1);
   /**
    * Load the SVM parameters and model from a text file with LIBSVM format.
    *
@@ -217,4 +353,104 @@ extern "C" void Init_libsvmext(void) {
    * @return [Boolean] true on success, or false if an error occurs.
    */
   rb_define_module_function(mLibsvm, "save_svm_model", RUBY_METHOD_FUNC(numo_libsvm_save_model), 3);
+
+  /**
+   * Document-class: Numo::Libsvm::CompiledModel
+   * CompiledModel keeps a trained model converted and compiled for prediction, and predicts one sample at a time
+   * without converting the model hash or allocating work memory on each call.
+   *
+   * @example
+   *   compiled = Numo::Libsvm::CompiledModel.new(param, model)
+   *   compiled.predict([0.5, -0.4])
+   *   compiled.predict({ 0 => 0.5, 1 => -0.4 })
+   */
+  VALUE cCompiledModel = rb_define_class_under(mLibsvm, "CompiledModel", rb_cObject);
+  rb_define_alloc_func(cCompiledModel, numo_libsvm_compiled_model_alloc);
+  /**
+   * Create a compiled model from the trained model.
+   *
+   * @overload new(param, model) -> CompiledModel
+   *   @param param [Hash] The parameters of the trained SVM model, including the prediction options
+   *     early_termination, tree_tolerance, and sv_precision.
+   *   @param model [Hash] The model obtained from the training procedure.
+   */
+  rb_define_method(cCompiledModel, "initialize", RUBY_METHOD_FUNC(numo_libsvm_compiled_model_init), 2);
+  /**
+   * Predict class label or value for the given sample.
+   *
+   * @overload predict(x) -> Float
+   *   @param x [Numo::DFloat/Array<Float>/Hash{Integer=>Float}] (shape: [n_features]) The sample to be predicted,
+   *     or the hash of its nonzero features whose keys are the feature indices starting from 0.
+   *
+   * @raise [ArgumentError] If the sample array is not 1-dimensional or a feature index is negative.
+   * @return [Float] Predicted class label or value.
+   */
+  rb_define_method(cCompiledModel, "predict", RUBY_METHOD_FUNC(numo_libsvm_compiled_model_predict), 1);
+  /**
+   * Calculate decision values for the given sample.
+   *
+   * @overload decision_function(x) -> Float or Array<Float>
+   *   @param x [Numo::DFloat/Array<Float>/Hash{Integer=>Float}] (shape: [n_features]) The sample to calculate
+   *     the decision values, or the hash of its nonzero features whose keys are the feature indices starting from 0.
+   *
+   * @raise [ArgumentError] If the sample array is not 1-dimensional or a feature index is negative.
+   * @return [Float/Array<Float>] The decision value, or the decision values of the one-vs-one classifiers
+   *   for multi-class classification (in the same order as decision_function of Numo::Libsvm).
+   */
+  rb_define_method(cCompiledModel, "decision_function", RUBY_METHOD_FUNC(numo_libsvm_compiled_model_decision_function), 1);
+  /**
+   * Describe how the compiled model evaluates the prediction (same as compiled_model_info of Numo::Libsvm).
+   *
+   * @overload info() -> Hash
+   *
+   * @return [Hash] The hash with the same keys as compiled_model_info. :sv_node_bytes is 0 when the sparse rows
+   *   of support vectors are freed because the weight vector, the polynomial map, or the single precision or 8-bit
+   *   integer support vectors replace them.
+   */
+  rb_define_method(cCompiledModel, "info", RUBY_METHOD_FUNC(numo_libsvm_compiled_model_get_info), 0);
+
+  /**
+   * Document-class: Numo::Libsvm::TrainingJob
+   * TrainingJob is the handle of a training started by train_async.
+   */
+  VALUE cTrainingJob = rb_define_class_under(mLibsvm, "TrainingJob", rb_cObject);
+  rb_undef_alloc_func(cTrainingJob);
+  /**
+   * Wait for the training to finish without holding the GVL, and return the trained model.
+   * The model of a cancelled training is the feasible solution found until it was cancelled, and its :converged is false.
+   *
+   * @overload wait() -> Hash
+   *
+   * @return [Hash] The model obtained from the training procedure.
+   */
+  rb_define_method(cTrainingJob, "wait", RUBY_METHOD_FUNC(numo_libsvm_training_job_wait), 0);
+  /**
+   * Return whether the training has finished.
+   *
+   * @overload done?() -> Boolean
+   */
+  rb_define_method(cTrainingJob, "done?", RUBY_METHOD_FUNC(numo_libsvm_training_job_is_done), 0);
+  /**
+   * Request the training to stop. The solver stops at its next iteration, and the remaining
+   * one-vs-one subproblems are not trained.
+   *
+   * @overload cancel() -> TrainingJob
+   */
+  rb_define_method(cTrainingJob, "cancel", RUBY_METHOD_FUNC(numo_libsvm_training_job_cancel), 0);
+  /**
+   * Return whether the training has been requested to stop.
+   *
+   * @overload cancelled?() -> Boolean
+   */
+  rb_define_method(cTrainingJob, "cancelled?", RUBY_METHOD_FUNC(numo_libsvm_training_job_is_cancelled), 0);
+  /**
+   * Return the progress of the solver of the current subproblem.
+   *
+   * @overload progress() -> Hash
+   *
+   * @return [Hash] The hash with keys :iter (the number of iterations), :obj (the objective value),
+   *   :active_size (the number of variables not shrunk), :subproblem (the index of the current
+   *   one-vs-one subproblem of multi-class classification), and :nr_subproblem.
+   */
+  rb_define_method(cTrainingJob, "progress", RUBY_METHOD_FUNC(numo_libsvm_training_job_progress), 0);
 }
@@ -31,16 +31,26 @@
 #ifndef LIBSVMEXT_HPP
 #define LIBSVMEXT_HPP 1
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 #include <ruby.h>
+#include <ruby/thread.h>
 
 #include <numo/narray.h>
 #include <numo/template.h>
 
 #include <svm.h>
 
+typedef struct svm_compile_parameter LibSvmCompileParameter;
 typedef struct svm_model LibSvmModel;
 typedef struct svm_node LibSvmNode;
 typedef struct svm_parameter LibSvmParameter;
@@ -48,6 +58,10 @@ typedef struct svm_problem LibSvmProblem;
 
 void printNull(const char* s) {}
 
+double getMonotonicTime() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 /** CONVERTERS */
 VALUE convertVectorXiToNArray(const int* const arr, const int size) {
   size_t shape[1] = {(size_t)size};
@@ -223,6 +237,9 @@ LibSvmModel* convertHashToLibSvmModel(VALUE model_hash) {
   model->nSV = convertNArrayToVectorXi(el);
   el = rb_hash_aref(model_hash, ID2SYM(rb_intern("free_sv")));
   model->free_sv = !NIL_P(el) ? NUM2INT(el) : 0;
+  el = rb_hash_aref(model_hash, ID2SYM(rb_intern("converged")));
+  model->converged = RB_TYPE_P(el, T_FALSE) ? 0 : 1;
+  model->compiled = NULL;
   return model;
 }
 
@@ -249,6 +266,7 @@ VALUE convertLibSvmModelToHash(const LibSvmModel* const model) {
   rb_hash_aset(model_hash, ID2SYM(rb_intern("label")), labels);
   rb_hash_aset(model_hash, ID2SYM(rb_intern("nSV")), n_support_vecs_each_class);
   rb_hash_aset(model_hash, ID2SYM(rb_intern("free_sv")), INT2NUM(model->free_sv));
+  rb_hash_aset(model_hash, ID2SYM(rb_intern("converged")), model->converged ? Qtrue : Qfalse);
   return model_hash;
 }
 
@@ -281,6 +299,11 @@ LibSvmParameter* convertHashToLibSvmParameter(VALUE param_hash) {
   param->shrinking = RB_TYPE_P(el, T_FALSE) ? 0 : 1;
   el = rb_hash_aref(param_hash, ID2SYM(rb_intern("probability")));
   param->probability = RB_TYPE_P(el, T_TRUE) ? 1 : 0;
+  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("max_iter")));
+  param->max_iter = !NIL_P(el) ? NUM2INT(el) : 0;
+  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("max_time")));
+  param->max_time = !NIL_P(el) ? NUM2DBL(el) : 0;
+  param->monitor = NULL;
   el = rb_hash_aref(param_hash, ID2SYM(rb_intern("weight_label")));
   param->weight_label = NULL;
   if (!NIL_P(el)) {
@@ -318,25 +341,110 @@ VALUE convertLibSvmParameterToHash(const LibSvmParameter* const param) {
   return param_hash;
 }
 
-LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val) {
-  narray_t* x_nary;
-  GetNArray(x_val, x_nary);
-  const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  const double* const y_ptr = (double*)na_get_pointer_for_read(y_val);
+LibSvmCompileParameter convertHashToLibSvmCompileParameter(VALUE param_hash) {
+  LibSvmCompileParameter compile_param;
+  VALUE el;
+  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("early_termination")));
+  compile_param.early_termination = RTEST(el) ? 1 : 0;
+  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("tree_tolerance")));
+  compile_param.tree_tolerance = !NIL_P(el) ? NUM2DBL(el) : 0.0;
+  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("sv_precision")));
+  compile_param.sv_precision = !NIL_P(el) ? NUM2INT(el) : SV_FLOAT64;
+  return compile_param;
+}
 
-  LibSvmProblem* problem = ALLOC(LibSvmProblem);
-  problem->l = n_samples;
-  problem->x = ALLOC_N(LibSvmNode*, n_samples);
-  problem->y = ALLOC_N(double, n_samples);
+/**
+ * Whether to compile the model for predicting n_samples samples in one call. Compiling costs about as much as
+ * predicting a few samples, so small batches are predicted with the model as it is; CompiledModel keeps a compiled
+ * model across calls. The parameters that change the results (sv_precision and tree_tolerance) always compile,
+ * so that the results do not depend on the batch size.
+ */
+bool isCompiledForBatch(const LibSvmCompileParameter& compile_param, const int n_samples) {
+  if (compile_param.sv_precision != SV_FLOAT64 || compile_param.tree_tolerance > 0) return true;
+  return n_samples >= 16;
+}
+
+VALUE convertLibSvmCompiledModelInfoToHash(const struct svm_compiled_model_info* const info) {
+  VALUE info_hash = rb_hash_new();
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("weight_vector")), info->weight_vector ? Qtrue : Qfalse);
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("polynomial_map")), info->polynomial_map ? Qtrue : Qfalse);
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("dense_sv")), info->dense_sv ? Qtrue : Qfalse);
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("early_termination")), info->early_termination ? Qtrue : Qfalse);
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("tree_nodes")), INT2NUM(info->tree_nodes));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("error_bound")), DBL2NUM(info->error_bound));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("sv_precision")), INT2NUM(info->sv_precision));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("sv_bytes")), LONG2NUM(info->sv_bytes));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("quantization_error")), DBL2NUM(info->quantization_error));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("sv_node_bytes")), LONG2NUM(info->sv_node_bytes));
+  return info_hash;
+}
 
+/**
+ * Elements of a 2-D Numo::DFloat, Numo::SFloat, or Numo::Int32 array, or of a view of it such as a slice or
+ * a transposed array, read in place through the strides (or index arrays) of the view.
+ */
+typedef struct {
+  VALUE klass;
+  const char* ptr;
+  ssize_t stride[2];
+  const size_t* index[2];  // byte offsets of the rows or columns selected by index arrays, or NULL
+} NArrayMatrix;
+
+bool isNArrayMatrixClass(VALUE klass) { return klass == numo_cDFloat || klass == numo_cSFloat || klass == numo_cInt32; }
+
+NArrayMatrix getNArrayMatrix(VALUE mat_val) {
+  narray_t* mat_nary;
+  GetNArray(mat_val, mat_nary);
+  NArrayMatrix mat;
+  mat.klass = CLASS_OF(mat_val);
+  const size_t elem_size =
+    mat.klass == numo_cSFloat ? sizeof(float) : (mat.klass == numo_cInt32 ? sizeof(int32_t) : sizeof(double));
+  mat.ptr = na_get_pointer_for_read(mat_val) + na_get_offset(mat_val);
+  mat.stride[0] = (ssize_t)(elem_size * NA_SHAPE(mat_nary)[1]);
+  mat.stride[1] = (ssize_t)elem_size;
+  mat.index[0] = NULL;
+  mat.index[1] = NULL;
+  if (NA_TYPE(mat_nary) == NARRAY_VIEW_T) {
+    const stridx_t* const stridx = NA_VIEW_STRIDX(mat_nary);
+    for (int k = 0; stridx != NULL && k < 2; k++) {
+      if (SDX_IS_INDEX(stridx[k])) {
+        mat.index[k] = SDX_GET_INDEX(stridx[k]);
+      } else {
+        mat.stride[k] = SDX_GET_STRIDE(stridx[k]);
+      }
+    }
+  }
+  return mat;
+}
+
+bool isContiguousNArrayMatrix(const NArrayMatrix& mat, const int n_rows, const int n_cols) {
+  if (mat.index[0] != NULL || mat.index[1] != NULL) return false;
+  const ssize_t elem_size = mat.klass == numo_cDFloat ? (ssize_t)sizeof(double) : (ssize_t)sizeof(float);
+  return (n_cols <= 1 || mat.stride[1] == elem_size) && (n_rows <= 1 || mat.stride[0] == elem_size * n_cols);
+}
+
+template <typename T> T getNArrayMatrixElement(const NArrayMatrix& mat, const int i, const int j) {
+  const ssize_t row_offset = mat.index[0] != NULL ? (ssize_t)mat.index[0][i] : i * mat.stride[0];
+  const ssize_t col_offset = mat.index[1] != NULL ? (ssize_t)mat.index[1][j] : j * mat.stride[1];
+  return *(const T*)(mat.ptr + row_offset + col_offset);
+}
+
+template <typename T>
+void copyNArrayMatrixRows(const NArrayMatrix& mat, const int row_begin, const int row_end, const int n_cols, double* out) {
+  for (int i = row_begin; i < row_end; i++) {
+    for (int j = 0; j < n_cols; j++) *(out++) = getNArrayMatrixElement<T>(mat, i, j);
+  }
+}
+
+template <typename T>
+void setLibSvmProblemSamples(LibSvmProblem* problem, const NArrayMatrix& x, const double* const y_ptr, const int n_samples,
+                             const int n_features) {
   int last_feature_id = 0;
   bool is_padded = false;
   for (int i = 0; i < n_samples; i++) {
     int n_nonzero_features = 0;
     for (int j = 0; j < n_features; j++) {
-      if (x_ptr[i * n_features + j] != 0.0) {
+      if (getNArrayMatrixElement<T>(x, i, j) != 0) {
         n_nonzero_features += 1;
         last_feature_id = j + 1;
       }
@@ -348,9 +456,10 @@ LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val) {
       problem->x[i] = ALLOC_N(LibSvmNode, n_nonzero_features + 2);
     }
     for (int j = 0, k = 0; j < n_features; j++) {
-      if (x_ptr[i * n_features + j] != 0.0) {
+      const T value = getNArrayMatrixElement<T>(x, i, j);
+      if (value != 0) {
         problem->x[i][k].index = j + 1;
-        problem->x[i][k].value = x_ptr[i * n_features + j];
+        problem->x[i][k].value = value;
         k++;
       }
     }
@@ -365,6 +474,28 @@ LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val) {
     }
     problem->y[i] = y_ptr[i];
   }
+}
+
+LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val) {
+  narray_t* x_nary;
+  GetNArray(x_val, x_nary);
+  const int n_samples = (int)NA_SHAPE(x_nary)[0];
+  const int n_features = (int)NA_SHAPE(x_nary)[1];
+  const double* const y_ptr = (double*)na_get_pointer_for_read(y_val);
+
+  LibSvmProblem* problem = ALLOC(LibSvmProblem);
+  problem->l = n_samples;
+  problem->x = ALLOC_N(LibSvmNode*, n_samples);
+  problem->y = ALLOC_N(double, n_samples);
+
+  const NArrayMatrix x = getNArrayMatrix(x_val);
+  if (x.klass == numo_cSFloat) {
+    setLibSvmProblemSamples<float>(problem, x, y_ptr, n_samples, n_features);
+  } else if (x.klass == numo_cInt32) {
+    setLibSvmProblemSamples<int32_t>(problem, x, y_ptr, n_samples, n_features);
+  } else {
+    setLibSvmProblemSamples<double>(problem, x, y_ptr, n_samples, n_features);
+  }
 
   RB_GC_GUARD(x_val);
   RB_GC_GUARD(y_val);
@@ -381,8 +512,112 @@ bool isProbabilisticModel(LibSvmModel* model) {
   return ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) && model->probA != NULL && model->probB != NULL);
 }
 
+/** Seconds spent in the phases of predict, decision_function and predict_proba. */
+struct PredictTiming {
+  double convert_model;
+  double compile;
+  double convert_samples;
+  double predict;
+};
+
+VALUE setPredictTimingHash(VALUE timing_hash, const PredictTiming* const timing) {
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("convert_model")), DBL2NUM(timing->convert_model));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("compile")), DBL2NUM(timing->compile));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("convert_samples")), DBL2NUM(timing->convert_samples));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("predict")), DBL2NUM(timing->predict));
+  return timing_hash;
+}
+
+/**
+ * Predict with svm_predict_dense. Contiguous Numo::DFloat samples are passed as they are, and others are
+ * converted to double in blocks of rows, so that no copy of the whole array is made.
+ */
+void predictLibSvmModel(LibSvmModel* model, VALUE x_val, double* labels, double* dec_values, double* prob_estimates,
+                        PredictTiming* timing = NULL) {
+  narray_t* x_nary;
+  GetNArray(x_val, x_nary);
+  const int n_samples = (int)NA_SHAPE(x_nary)[0];
+  const int n_features = (int)NA_SHAPE(x_nary)[1];
+  const NArrayMatrix x = getNArrayMatrix(x_val);
+  double t = getMonotonicTime();
+  if (x.klass == numo_cDFloat && isContiguousNArrayMatrix(x, n_samples, n_features)) {
+    svm_predict_dense(model, (const double*)x.ptr, n_samples, n_features, labels, dec_values, prob_estimates);
+    if (timing) timing->predict += getMonotonicTime() - t;
+    return;
+  }
+
+  const int n_dec = isSignleOutputModel(model) ? 1 : model->nr_class * (model->nr_class - 1) / 2;
+  const int n_block_samples = std::min(n_samples, std::max(256, (1 << 20) / std::max(1, n_features)));
+  double* block = ALLOC_N(double, (size_t)n_block_samples * n_features);
+  for (int begin = 0; begin < n_samples; begin += n_block_samples) {
+    const int end = std::min(begin + n_block_samples, n_samples);
+    if (x.klass == numo_cSFloat) {
+      copyNArrayMatrixRows<float>(x, begin, end, n_features, block);
+    } else if (x.klass == numo_cInt32) {
+      copyNArrayMatrixRows<int32_t>(x, begin, end, n_features, block);
+    } else {
+      copyNArrayMatrixRows<double>(x, begin, end, n_features, block);
+    }
+    if (timing) {
+      const double now = getMonotonicTime();
+      timing->convert_samples += now - t;
+      t = now;
+    }
+    svm_predict_dense(model, block, end - begin, n_features, labels ? labels + begin : NULL,
+                      dec_values ? dec_values + (size_t)begin * n_dec : NULL,
+                      prob_estimates ? prob_estimates + (size_t)begin * model->nr_class : NULL);
+    if (timing) {
+      const double now = getMonotonicTime();
+      timing->predict += now - t;
+      t = now;
+    }
+  }
+  xfree(block);
+}
+
+VALUE checkTimingKeywordArgument(VALUE timing_val) {
+  if (timing_val == Qundef) return Qnil;
+  if (!NIL_P(timing_val) && !RB_TYPE_P(timing_val, T_HASH)) rb_raise(rb_eArgError, "Expect timing to be a Hash.");
+  return timing_val;
+}
+
+void getPredictKeywordArguments(VALUE kw_args, VALUE* out_val, VALUE* timing_val) {
+  *out_val = Qnil;
+  *timing_val = Qnil;
+  if (NIL_P(kw_args)) return;
+  ID kw_table[2] = {rb_intern("out"), rb_intern("timing")};
+  VALUE kw_values[2] = {Qundef, Qundef};
+  rb_get_kwargs(kw_args, kw_table, 0, 2, kw_values);
+  if (kw_values[0] != Qundef) *out_val = kw_values[0];
+  *timing_val = checkTimingKeywordArgument(kw_values[1]);
+}
+
+VALUE getTimingKeywordArgument(VALUE kw_args) {
+  if (NIL_P(kw_args)) return Qnil;
+  ID kw_table[1] = {rb_intern("timing")};
+  VALUE kw_values[1] = {Qundef};
+  rb_get_kwargs(kw_args, kw_table, 0, 1, kw_values);
+  return checkTimingKeywordArgument(kw_values[0]);
+}
+
+bool isOutputNArray(VALUE out_val, const int n_dims, const size_t* shape) {
+  if (CLASS_OF(out_val) != numo_cDFloat || OBJ_FROZEN(out_val)) return false;
+  narray_t* out_nary;
+  GetNArray(out_val, out_nary);
+  if (NA_NDIM(out_nary) != n_dims) return false;
+  for (int i = 0; i < n_dims; i++) {
+    if (NA_SHAPE(out_nary)[i] != shape[i]) return false;
+  }
+  return RTEST(nary_check_contiguous(out_val));
+}
+
+double* getOutputNArrayPointer(VALUE out_val) {
+  return (double*)(na_get_pointer_for_write(out_val) + na_get_offset(out_val));
+}
+
 void deleteLibSvmModel(LibSvmModel* model) {
   if (model) {
+    svm_free_compiled_model(model);
     if (model->SV) {
       for (int i = 0; i < model->l; i++) xfree(model->SV[i]);
       xfree(model->SV);
@@ -447,10 +682,125 @@ void deleteLibSvmProblem(LibSvmProblem* problem) {
 }
 
 /** MODULE FUNCTIONS */
+/**
+ * Telemetry samples of the solver collected during training, and the Ruby callback that is called with each sample
+ * while training on the calling Ruby thread. An exception raised by the callback cancels the training, and is
+ * raised again once the training has returned.
+ */
+struct TelemetryRecorder {
+  std::vector<struct svm_telemetry> samples;
+  VALUE callback;
+  int state;
+  struct svm_monitor* monitor;
+};
+
+VALUE convertLibSvmTelemetryToHash(const struct svm_telemetry* const telemetry) {
+  VALUE telemetry_hash = rb_hash_new();
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("subproblem")), INT2NUM(telemetry->subproblem));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("iter")), INT2NUM(telemetry->iter));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("obj")), DBL2NUM(telemetry->obj));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("kkt_violation")), DBL2NUM(telemetry->kkt_violation));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("active_size")), INT2NUM(telemetry->active_size));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("nr_shrink")), INT2NUM(telemetry->nr_shrink));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("nr_reconstruct")), INT2NUM(telemetry->nr_reconstruct));
+  rb_hash_aset(telemetry_hash, ID2SYM(rb_intern("finished")), telemetry->finished ? Qtrue : Qfalse);
+  return telemetry_hash;
+}
+
+VALUE convertTelemetryRecorderToArray(const TelemetryRecorder* const recorder) {
+  const long n_samples = (long)recorder->samples.size();
+  VALUE telemetry_ary = rb_ary_new2(n_samples);
+  for (long i = 0; i < n_samples; i++) rb_ary_store(telemetry_ary, i, convertLibSvmTelemetryToHash(&recorder->samples[i]));
+  return telemetry_ary;
+}
+
+VALUE callTelemetryCallback(VALUE arg) {
+  TelemetryRecorder* recorder = (TelemetryRecorder*)arg;
+  return rb_funcall(recorder->callback, rb_intern("call"), 1, convertLibSvmTelemetryToHash(&recorder->samples.back()));
+}
+
+void recordTelemetry(const struct svm_telemetry* telemetry, void* data) {
+  TelemetryRecorder* recorder = (TelemetryRecorder*)data;
+  recorder->samples.push_back(*telemetry);
+  if (NIL_P(recorder->callback) || recorder->state != 0) return;
+  rb_protect(callTelemetryCallback, (VALUE)recorder, &recorder->state);
+  if (recorder->state != 0) recorder->monitor->cancel.store(1, std::memory_order_relaxed);
+}
+
+/**
+ * Seeds the random numbers of the training with the monitor from random_seed of the parameter hash, and returns
+ * whether the seed is given. The generator belongs to the monitor, so that training jobs on other threads do not
+ * share the state of rand().
+ */
+bool setRandomSeed(VALUE param_hash, struct svm_monitor* monitor) {
+  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
+  if (NIL_P(random_seed)) return false;
+  monitor->has_rng = 1;
+  monitor->rng = NUM2UINT(random_seed);
+  return true;
+}
+
+/**
+ * Sets the telemetry of the monitor from telemetry_interval and telemetry_callback of the parameter hash, and returns
+ * whether telemetry is requested. It raises ArgumentError before anything is allocated for training.
+ */
+bool setTelemetryRecorder(VALUE param_hash, struct svm_monitor* monitor, TelemetryRecorder* recorder, const bool allow_callback) {
+  VALUE interval = rb_hash_aref(param_hash, ID2SYM(rb_intern("telemetry_interval")));
+  VALUE callback = rb_hash_aref(param_hash, ID2SYM(rb_intern("telemetry_callback")));
+  if (NIL_P(interval) && NIL_P(callback)) return false;
+  const int interval_ = !NIL_P(interval) ? NUM2INT(interval) : 1000;
+  if (interval_ < 0) rb_raise(rb_eArgError, "Expect telemetry_interval to be non-negative.");
+  if (!NIL_P(callback) && !allow_callback) rb_raise(rb_eArgError, "telemetry_callback is not supported by train_async.");
+  if (!NIL_P(callback) && !rb_respond_to(callback, rb_intern("call"))) {
+    rb_raise(rb_eArgError, "Expect telemetry_callback to respond to call.");
+  }
+  recorder->callback = callback;
+  recorder->state = 0;
+  recorder->monitor = monitor;
+  monitor->telemetry_interval = interval_;
+  monitor->telemetry = recordTelemetry;
+  monitor->telemetry_data = recorder;
+  return true;
+}
+
+/**
+ * Returns the seconds spent in the phases of train: converting the dataset into the problem, the phases of svm_train
+ * with those of each one-vs-one pair, and converting the model into a hash.
+ */
+VALUE convertLibSvmTimingToHash(const struct svm_timing* const timing, const double convert_dataset, const double convert_model) {
+  VALUE timing_hash = rb_hash_new();
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("convert_dataset")), DBL2NUM(convert_dataset));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("group_classes")), DBL2NUM(timing->group_classes));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("probability")), DBL2NUM(timing->probability));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("solve")), DBL2NUM(timing->solve));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("assemble")), DBL2NUM(timing->assemble));
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("convert_model")), DBL2NUM(convert_model));
+  VALUE pairs = rb_ary_new2(timing->nr_pair);
+  for (int i = 0; i < timing->nr_pair; i++) {
+    VALUE pair_hash = rb_hash_new();
+    rb_hash_aset(pair_hash, ID2SYM(rb_intern("probability")), DBL2NUM(timing->pair_probability[i]));
+    rb_hash_aset(pair_hash, ID2SYM(rb_intern("solve")), DBL2NUM(timing->pair_solve[i]));
+    rb_ary_store(pairs, i, pair_hash);
+  }
+  rb_hash_aset(timing_hash, ID2SYM(rb_intern("pairs")), pairs);
+  return timing_hash;
+}
+
+VALUE convertLibSvmKernelStatsToHash(const struct svm_kernel_stats* const stats) {
+  VALUE stats_hash = rb_hash_new();
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("cache_hits")), LL2NUM(stats->cache_hits));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("cache_misses")), LL2NUM(stats->cache_misses));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("cache_evictions")), LL2NUM(stats->cache_evictions));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("cache_bytes")), LL2NUM(stats->cache_bytes));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("train_kernel_evaluations")), LL2NUM(stats->train_kernel_evaluations));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("predict_kernel_evaluations")), LL2NUM(stats->predict_kernel_evaluations));
+  rb_hash_aset(stats_hash, ID2SYM(rb_intern("fill_time")), DBL2NUM(stats->fill_time));
+  return stats_hash;
+}
+
 static VALUE numo_libsvm_train(VALUE self, VALUE x_val, VALUE y_val, VALUE param_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
   if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
   if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
 
   narray_t* x_nary;
@@ -470,11 +820,21 @@ static VALUE numo_libsvm_train(VALUE self, VALUE x_val, VALUE y_val, VALUE param
     return Qnil;
   }
 
-  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
-  if (!NIL_P(random_seed)) srand(NUM2UINT(random_seed));
-
+  struct svm_monitor monitor;
+  svm_init_monitor(&monitor);
+  TelemetryRecorder recorder;
+  const bool has_telemetry = setTelemetryRecorder(param_hash, &monitor, &recorder, true);
+  const bool has_kernel_stats = RTEST(rb_hash_aref(param_hash, ID2SYM(rb_intern("kernel_stats"))));
+  const bool has_timing = RTEST(rb_hash_aref(param_hash, ID2SYM(rb_intern("timing"))));
+  struct svm_timing timing;
+  memset(&timing, 0, sizeof(timing));
+  if (has_timing) monitor.timing = &timing;
+  const bool has_random_seed = setRandomSeed(param_hash, &monitor);
+
+  double t = getMonotonicTime();
   LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
   LibSvmProblem* problem = convertDatasetToLibSvmProblem(x_val, y_val);
+  const double convert_dataset_time = getMonotonicTime() - t;
 
   const char* err_msg = svm_check_parameter(problem, param);
   if (err_msg) {
@@ -487,8 +847,26 @@ static VALUE numo_libsvm_train(VALUE self, VALUE x_val, VALUE y_val, VALUE param
   VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
   if (!RTEST(verbose)) svm_set_print_string_function(printNull);
 
+  if (has_telemetry || has_kernel_stats || has_timing || has_random_seed) param->monitor = &monitor;
   LibSvmModel* model = svm_train(problem, param);
+  if (has_telemetry && recorder.state != 0) {
+    svm_free_and_destroy_model(&model);
+    deleteLibSvmProblem(problem);
+    deleteLibSvmParameter(param);
+    std::vector<struct svm_telemetry>().swap(recorder.samples);
+    svm_free_timing(&timing);
+    rb_jump_tag(recorder.state);
+    return Qnil;
+  }
+  t = getMonotonicTime();
   VALUE model_hash = convertLibSvmModelToHash(model);
+  const double convert_model_time = getMonotonicTime() - t;
+  if (has_telemetry) rb_hash_aset(model_hash, ID2SYM(rb_intern("telemetry")), convertTelemetryRecorderToArray(&recorder));
+  if (has_kernel_stats) rb_hash_aset(model_hash, ID2SYM(rb_intern("kernel_stats")), convertLibSvmKernelStatsToHash(&monitor.kernel_stats));
+  if (has_timing) {
+    rb_hash_aset(model_hash, ID2SYM(rb_intern("timing")), convertLibSvmTimingToHash(&timing, convert_dataset_time, convert_model_time));
+    svm_free_timing(&timing);
+  }
   svm_free_and_destroy_model(&model);
 
   deleteLibSvmProblem(problem);
@@ -500,10 +878,12 @@ static VALUE numo_libsvm_train(VALUE self, VALUE x_val, VALUE y_val, VALUE param
   return model_hash;
 }
 
-static VALUE numo_libsvm_cross_validation(VALUE self, VALUE x_val, VALUE y_val, VALUE param_hash, VALUE nr_folds) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+static VALUE numo_libsvm_cross_validation(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, y_val, param_hash, nr_folds, kw_args;
+  rb_scan_args(argc, argv, "4:", &x_val, &y_val, &param_hash, &nr_folds, &kw_args);
+  VALUE timing_val = getTimingKeywordArgument(kw_args);
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
   if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
   if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
 
   narray_t* x_nary;
@@ -523,11 +903,14 @@ static VALUE numo_libsvm_cross_validation(VALUE self, VALUE x_val, VALUE y_val,
     return Qnil;
   }
 
-  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
-  if (!NIL_P(random_seed)) srand(NUM2UINT(random_seed));
+  struct svm_monitor monitor;
+  svm_init_monitor(&monitor);
+  const bool has_random_seed = setRandomSeed(param_hash, &monitor);
 
+  double t = getMonotonicTime();
   LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
   LibSvmProblem* problem = convertDatasetToLibSvmProblem(x_val, y_val);
+  const double convert_dataset_time = getMonotonicTime() - t;
 
   const char* err_msg = svm_check_parameter(problem, param);
   if (err_msg) {
@@ -544,21 +927,36 @@ static VALUE numo_libsvm_cross_validation(VALUE self, VALUE x_val, VALUE y_val,
   VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
   if (!RTEST(verbose)) svm_set_print_string_function(printNull);
 
+  struct svm_timing timing;
+  memset(&timing, 0, sizeof(timing));
+  if (!NIL_P(timing_val)) monitor.timing = &timing;
+  if (!NIL_P(timing_val) || has_random_seed) param->monitor = &monitor;
+
   const int n_folds = NUM2INT(nr_folds);
   svm_cross_validation(problem, param, n_folds, t_pt);
 
   deleteLibSvmProblem(problem);
   deleteLibSvmParameter(param);
 
+  if (!NIL_P(timing_val)) {
+    rb_hash_aset(timing_val, ID2SYM(rb_intern("convert_dataset")), DBL2NUM(convert_dataset_time));
+    rb_hash_aset(timing_val, ID2SYM(rb_intern("group_classes")), DBL2NUM(timing.group_classes));
+    rb_hash_aset(timing_val, ID2SYM(rb_intern("train")), DBL2NUM(timing.train));
+    rb_hash_aset(timing_val, ID2SYM(rb_intern("predict")), DBL2NUM(timing.predict));
+  }
+
   RB_GC_GUARD(x_val);
   RB_GC_GUARD(y_val);
 
   return t_val;
 }
 
-static VALUE numo_libsvm_predict(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+static VALUE numo_libsvm_predict(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, param_hash, model_hash, kw_args;
+  rb_scan_args(argc, argv, "3:", &x_val, &param_hash, &model_hash, &kw_args);
+  VALUE out_val, timing_val;
+  getPredictKeywordArguments(kw_args, &out_val, &timing_val);
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
 
   narray_t* x_nary;
   GetNArray(x_val, x_nary);
@@ -567,33 +965,45 @@ static VALUE numo_libsvm_predict(VALUE self, VALUE x_val, VALUE param_hash, VALU
     return Qnil;
   }
 
+  PredictTiming timing = {0, 0, 0, 0};
+  double t = getMonotonicTime();
   LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
   LibSvmModel* model = convertHashToLibSvmModel(model_hash);
   model->param = *param;
+  timing.convert_model = getMonotonicTime() - t;
+  t = getMonotonicTime();
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  if (isCompiledForBatch(compile_param, (int)NA_SHAPE(x_nary)[0])) svm_compile_model(model, &compile_param);
+  timing.compile = getMonotonicTime() - t;
 
   const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
   size_t y_shape[1] = {(size_t)n_samples};
-  VALUE y_val = rb_narray_new(numo_cDFloat, 1, y_shape);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    y_ptr[i] = svm_predict(model, x_nodes);
-    xfree(x_nodes);
+  if (!NIL_P(out_val) && !isOutputNArray(out_val, 1, y_shape)) {
+    deleteLibSvmModel(model);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Expect output array to be a writable contiguous Numo::DFloat of shape [n_samples].");
+    return Qnil;
   }
+  VALUE y_val = NIL_P(out_val) ? rb_narray_new(numo_cDFloat, 1, y_shape) : out_val;
+  double* y_ptr = getOutputNArrayPointer(y_val);
+  predictLibSvmModel(model, x_val, y_ptr, NULL, NULL, &timing);
 
   deleteLibSvmModel(model);
   deleteLibSvmParameter(param);
 
+  if (!NIL_P(timing_val)) setPredictTimingHash(timing_val, &timing);
+
   RB_GC_GUARD(x_val);
 
   return y_val;
 }
 
-static VALUE numo_libsvm_decision_function(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+static VALUE numo_libsvm_decision_function(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, param_hash, model_hash, kw_args;
+  rb_scan_args(argc, argv, "3:", &x_val, &param_hash, &model_hash, &kw_args);
+  VALUE out_val, timing_val;
+  getPredictKeywordArguments(kw_args, &out_val, &timing_val);
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
 
   narray_t* x_nary;
   GetNArray(x_val, x_nary);
@@ -602,34 +1012,46 @@ static VALUE numo_libsvm_decision_function(VALUE self, VALUE x_val, VALUE param_
     return Qnil;
   }
 
+  PredictTiming timing = {0, 0, 0, 0};
+  double t = getMonotonicTime();
   LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
   LibSvmModel* model = convertHashToLibSvmModel(model_hash);
   model->param = *param;
+  timing.convert_model = getMonotonicTime() - t;
+  t = getMonotonicTime();
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  if (isCompiledForBatch(compile_param, (int)NA_SHAPE(x_nary)[0])) svm_compile_model(model, &compile_param);
+  timing.compile = getMonotonicTime() - t;
 
   const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
   const int y_cols = isSignleOutputModel(model) ? 1 : model->nr_class * (model->nr_class - 1) / 2;
   size_t y_shape[2] = {(size_t)n_samples, (size_t)y_cols};
   const int n_dims = isSignleOutputModel(model) ? 1 : 2;
-  VALUE y_val = rb_narray_new(numo_cDFloat, n_dims, y_shape);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
-
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    svm_predict_values(model, x_nodes, &y_ptr[i * y_cols]);
-    xfree(x_nodes);
+  if (!NIL_P(out_val) && !isOutputNArray(out_val, n_dims, y_shape)) {
+    deleteLibSvmModel(model);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Expect output array to be a writable contiguous Numo::DFloat of the shape of decision values.");
+    return Qnil;
   }
+  VALUE y_val = NIL_P(out_val) ? rb_narray_new(numo_cDFloat, n_dims, y_shape) : out_val;
+  double* y_ptr = getOutputNArrayPointer(y_val);
+  predictLibSvmModel(model, x_val, NULL, y_ptr, NULL, &timing);
 
   deleteLibSvmModel(model);
   deleteLibSvmParameter(param);
 
+  if (!NIL_P(timing_val)) setPredictTimingHash(timing_val, &timing);
+
   RB_GC_GUARD(x_val);
 
   return y_val;
 }
 
-static VALUE numo_libsvm_predict_proba(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
+static VALUE numo_libsvm_predict_proba(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, param_hash, model_hash, kw_args;
+  rb_scan_args(argc, argv, "3:", &x_val, &param_hash, &model_hash, &kw_args);
+  VALUE out_val, timing_val;
+  getPredictKeywordArguments(kw_args, &out_val, &timing_val);
   narray_t* x_nary;
   GetNArray(x_val, x_nary);
   if (NA_NDIM(x_nary) != 2) {
@@ -637,39 +1059,193 @@ static VALUE numo_libsvm_predict_proba(VALUE self, VALUE x_val, VALUE param_hash
     return Qnil;
   }
 
+  PredictTiming timing = {0, 0, 0, 0};
+  double t = getMonotonicTime();
   LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
   LibSvmModel* model = convertHashToLibSvmModel(model_hash);
   model->param = *param;
+  timing.convert_model = getMonotonicTime() - t;
 
   if (!isProbabilisticModel(model)) {
     deleteLibSvmModel(model);
     deleteLibSvmParameter(param);
     return Qnil;
   }
+  t = getMonotonicTime();
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  if (isCompiledForBatch(compile_param, (int)NA_SHAPE(x_nary)[0])) svm_compile_model(model, &compile_param);
+  timing.compile = getMonotonicTime() - t;
 
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
 
   const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
   size_t y_shape[2] = {(size_t)n_samples, (size_t)(model->nr_class)};
-  VALUE y_val = rb_narray_new(numo_cDFloat, 2, y_shape);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    svm_predict_probability(model, x_nodes, &y_ptr[i * model->nr_class]);
-    xfree(x_nodes);
+  if (!NIL_P(out_val) && !isOutputNArray(out_val, 2, y_shape)) {
+    deleteLibSvmModel(model);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Expect output array to be a writable contiguous Numo::DFloat of shape [n_samples, n_classes].");
+    return Qnil;
   }
+  VALUE y_val = NIL_P(out_val) ? rb_narray_new(numo_cDFloat, 2, y_shape) : out_val;
+  double* y_ptr = getOutputNArrayPointer(y_val);
+  predictLibSvmModel(model, x_val, NULL, NULL, y_ptr, &timing);
 
   deleteLibSvmModel(model);
   deleteLibSvmParameter(param);
 
+  if (!NIL_P(timing_val)) setPredictTimingHash(timing_val, &timing);
+
   RB_GC_GUARD(x_val);
 
   return y_val;
 }
 
+static VALUE numo_libsvm_predict_all(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+
+  narray_t* x_nary;
+  GetNArray(x_val, x_nary);
+  if (NA_NDIM(x_nary) != 2) {
+    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
+    return Qnil;
+  }
+
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
+  model->param = *param;
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  const int n_samples = (int)NA_SHAPE(x_nary)[0];
+  if (isCompiledForBatch(compile_param, n_samples)) svm_compile_model(model, &compile_param);
+
+  size_t labels_shape[1] = {(size_t)n_samples};
+  VALUE labels_val = rb_narray_new(numo_cDFloat, 1, labels_shape);
+  const int dec_cols = isSignleOutputModel(model) ? 1 : model->nr_class * (model->nr_class - 1) / 2;
+  size_t dec_shape[2] = {(size_t)n_samples, (size_t)dec_cols};
+  VALUE dec_val = rb_narray_new(numo_cDFloat, isSignleOutputModel(model) ? 1 : 2, dec_shape);
+  VALUE probs_val = Qnil;
+  if (isProbabilisticModel(model)) {
+    size_t probs_shape[2] = {(size_t)n_samples, (size_t)(model->nr_class)};
+    probs_val = rb_narray_new(numo_cDFloat, 2, probs_shape);
+  }
+  double* labels_ptr = (double*)na_get_pointer_for_write(labels_val);
+  double* dec_ptr = (double*)na_get_pointer_for_write(dec_val);
+  double* probs_ptr = !NIL_P(probs_val) ? (double*)na_get_pointer_for_write(probs_val) : NULL;
+  predictLibSvmModel(model, x_val, labels_ptr, dec_ptr, probs_ptr);
+
+  deleteLibSvmModel(model);
+  deleteLibSvmParameter(param);
+
+  VALUE res = rb_ary_new2(3);
+  rb_ary_store(res, 0, labels_val);
+  rb_ary_store(res, 1, dec_val);
+  rb_ary_store(res, 2, probs_val);
+
+  RB_GC_GUARD(x_val);
+
+  return res;
+}
+
+static VALUE numo_libsvm_compiled_model_info(VALUE self, VALUE param_hash, VALUE model_hash) {
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
+  model->param = *param;
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  svm_compile_model(model, &compile_param);
+
+  struct svm_compiled_model_info info;
+  svm_get_compiled_model_info(model, &info);
+  VALUE info_hash = convertLibSvmCompiledModelInfoToHash(&info);
+
+  deleteLibSvmModel(model);
+  deleteLibSvmParameter(param);
+
+  return info_hash;
+}
+
+struct CompressModelArgs {
+  LibSvmModel* model;
+  double tolerance;
+  int max_sv;
+  double max_time;
+  struct svm_monitor monitor;
+  double error;
+  LibSvmModel* compressed_model;
+};
+
+void* compressModelWithoutGvl(void* ptr) {
+  CompressModelArgs* args = (CompressModelArgs*)ptr;
+  args->compressed_model = svm_compress_model(args->model, args->tolerance, args->max_sv, args->max_time, &args->error);
+  return NULL;
+}
+
+void cancelCompressModel(void* ptr) { ((CompressModelArgs*)ptr)->monitor.cancel.store(1, std::memory_order_relaxed); }
+
+static VALUE numo_libsvm_compress_model(int argc, VALUE* argv, VALUE self) {
+  VALUE param_hash, model_hash, tolerance, kw_args;
+  rb_scan_args(argc, argv, "3:", &param_hash, &model_hash, &tolerance, &kw_args);
+  ID kw_table[2] = {rb_intern("max_sv"), rb_intern("max_time")};
+  VALUE kw_values[2] = {Qundef, Qundef};
+  if (!NIL_P(kw_args)) rb_get_kwargs(kw_args, kw_table, 0, 2, kw_values);
+
+  const double tolerance_ = NUM2DBL(tolerance);
+  if (tolerance_ < 0) {
+    rb_raise(rb_eArgError, "Expect tolerance to be non-negative.");
+    return Qnil;
+  }
+  const int max_sv = kw_values[0] == Qundef || NIL_P(kw_values[0]) ? 0 : NUM2INT(kw_values[0]);
+  if (max_sv < 0) {
+    rb_raise(rb_eArgError, "Expect max_sv to be non-negative.");
+    return Qnil;
+  }
+  const double max_time = kw_values[1] == Qundef || NIL_P(kw_values[1]) ? 0 : NUM2DBL(kw_values[1]);
+  if (max_time < 0) {
+    rb_raise(rb_eArgError, "Expect max_time to be non-negative.");
+    return Qnil;
+  }
+
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
+  model->param = *param;
+
+  // compress without the GVL, so that an interrupt stops the compression through the monitor
+  CompressModelArgs args;
+  args.model = model;
+  args.tolerance = tolerance_;
+  args.max_sv = max_sv;
+  args.max_time = max_time;
+  svm_init_monitor(&args.monitor);
+  args.error = 0;
+  args.compressed_model = NULL;
+  model->param.monitor = &args.monitor;
+  rb_thread_call_without_gvl(compressModelWithoutGvl, &args, cancelCompressModel, &args);
+  LibSvmModel* compressed_model = args.compressed_model;
+  const int n_support_vecs = model->l;
+
+  deleteLibSvmModel(model);
+  deleteLibSvmParameter(param);
+
+  if (compressed_model == NULL) {
+    rb_raise(rb_eArgError, "Failed to compress the model: precomputed kernel is not supported.");
+    return Qnil;
+  }
+
+  VALUE compressed_model_hash = convertLibSvmModelToHash(compressed_model);
+  VALUE info_hash = rb_hash_new();
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("error")), DBL2NUM(args.error));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("l")), INT2NUM(compressed_model->l));
+  rb_hash_aset(info_hash, ID2SYM(rb_intern("original_l")), INT2NUM(n_support_vecs));
+  svm_free_and_destroy_model(&compressed_model);
+
+  VALUE res = rb_ary_new2(2);
+  rb_ary_store(res, 0, compressed_model_hash);
+  rb_ary_store(res, 1, info_hash);
+
+  // raise the interrupt that cancelled the compression, if any
+  rb_thread_check_ints();
+
+  return res;
+}
+
 static VALUE numo_libsvm_load_model(VALUE self, VALUE filename) {
   const char* const filename_ = StringValuePtr(filename);
   LibSvmModel* model = svm_load_model(filename_);
@@ -712,4 +1288,452 @@ static VALUE numo_libsvm_save_model(VALUE self, VALUE filename, VALUE param_hash
   return Qtrue;
 }
 
+/**
+ * Converted and compiled model held by Numo::Libsvm::CompiledModel. The node, decision value and scratch buffers are
+ * reused by every single-sample prediction, so that a call neither converts the model hash nor allocates work memory
+ * (nodes grow only for a sample with more nonzero features than any before).
+ */
+typedef struct {
+  LibSvmParameter* param;
+  LibSvmModel* model;
+  LibSvmNode* nodes;
+  int n_nodes;  // capacity of nodes including the terminal node
+  double* dec_values;
+  double* scratch;  // svm_predict_scratch_size(model) doubles
+} CompiledModelData;
+
+void freeCompiledModelData(void* ptr) {
+  CompiledModelData* data = (CompiledModelData*)ptr;
+  deleteLibSvmModel(data->model);
+  deleteLibSvmParameter(data->param);
+  xfree(data->nodes);
+  xfree(data->dec_values);
+  xfree(data->scratch);
+  xfree(data);
+}
+
+size_t sizeCompiledModelData(const void* ptr) {
+  const CompiledModelData* data = (const CompiledModelData*)ptr;
+  size_t size = sizeof(CompiledModelData) + sizeof(LibSvmNode) * data->n_nodes;
+  if (data->model != NULL) {
+    struct svm_compiled_model_info info;
+    svm_get_compiled_model_info(data->model, &info);
+    size += info.sv_bytes + info.sv_node_bytes + sizeof(double) * svm_predict_scratch_size(data->model);
+  }
+  return size;
+}
+
+const rb_data_type_t compiledModelDataType = {
+  "Numo::Libsvm::CompiledModel",
+  {NULL, freeCompiledModelData, sizeCompiledModelData},
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+CompiledModelData* getCompiledModelData(VALUE self) {
+  CompiledModelData* data;
+  TypedData_Get_Struct(self, CompiledModelData, &compiledModelDataType, data);
+  if (data->model == NULL) rb_raise(rb_eRuntimeError, "Compiled model is not initialized.");
+  return data;
+}
+
+void reserveCompiledModelNodes(CompiledModelData* data, const long n_nodes) {
+  if (n_nodes > INT_MAX) rb_raise(rb_eArgError, "Too many features are given.");
+  if (data->n_nodes >= n_nodes) return;
+  REALLOC_N(data->nodes, LibSvmNode, n_nodes);
+  data->n_nodes = (int)n_nodes;
+}
+
+template <typename T>
+int setCompiledModelNodes(LibSvmNode* nodes, const char* ptr, const ssize_t stride, const size_t* index, const int n_features) {
+  int k = 0;
+  for (int j = 0; j < n_features; j++) {
+    const T value = *(const T*)(ptr + (index != NULL ? (ssize_t)index[j] : j * stride));
+    if (value != 0) {
+      nodes[k].index = j + 1;
+      nodes[k].value = value;
+      k++;
+    }
+  }
+  return k;
+}
+
+typedef struct {
+  LibSvmNode* nodes;
+  int n_nodes;
+} LibSvmNodeList;
+
+int appendLibSvmNode(VALUE key, VALUE value, VALUE arg) {
+  LibSvmNodeList* list = (LibSvmNodeList*)arg;
+  const int index = NUM2INT(key);
+  if (index < 0 || index == INT_MAX) rb_raise(rb_eArgError, "Expect feature indices to be non-negative integers.");
+  const double value_ = NUM2DBL(value);
+  if (value_ != 0) {
+    list->nodes[list->n_nodes].index = index + 1;
+    list->nodes[list->n_nodes].value = value_;
+    list->n_nodes++;
+  }
+  return ST_CONTINUE;
+}
+
+int compareLibSvmNodeIndex(const void* a, const void* b) {
+  return ((const LibSvmNode*)a)->index - ((const LibSvmNode*)b)->index;
+}
+
+/**
+ * Converts a sample given as a 1-D Numo::NArray, an Array of Float, or a Hash of feature index (starting from 0)
+ * and value into the node buffer of the compiled model.
+ */
+const LibSvmNode* convertSampleToLibSvmNodes(CompiledModelData* data, VALUE x_val) {
+  int n_nonzero_features = 0;
+  if (RB_TYPE_P(x_val, T_HASH)) {
+    reserveCompiledModelNodes(data, (long)RHASH_SIZE(x_val) + 1);
+    LibSvmNodeList list = {data->nodes, 0};
+    rb_hash_foreach(x_val, appendLibSvmNode, (VALUE)&list);
+    n_nonzero_features = list.n_nodes;
+    qsort(data->nodes, n_nonzero_features, sizeof(LibSvmNode), compareLibSvmNodeIndex);
+    for (int k = 1; k < n_nonzero_features; k++) {
+      if (data->nodes[k].index == data->nodes[k - 1].index) rb_raise(rb_eArgError, "Expect feature indices to be unique.");
+    }
+  } else if (RB_TYPE_P(x_val, T_ARRAY)) {
+    const long n_features = RARRAY_LEN(x_val);
+    reserveCompiledModelNodes(data, n_features + 1);
+    for (long j = 0; j < n_features; j++) {
+      const double value = NUM2DBL(RARRAY_AREF(x_val, j));
+      if (value != 0) {
+        data->nodes[n_nonzero_features].index = (int)j + 1;
+        data->nodes[n_nonzero_features].value = value;
+        n_nonzero_features++;
+      }
+    }
+  } else {
+    if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+    narray_t* x_nary;
+    GetNArray(x_val, x_nary);
+    if (NA_NDIM(x_nary) != 1) rb_raise(rb_eArgError, "Expect sample to be 1-D array.");
+    const long n_features = (long)NA_SHAPE(x_nary)[0];
+    reserveCompiledModelNodes(data, n_features + 1);
+    const VALUE klass = CLASS_OF(x_val);
+    const ssize_t elem_size =
+      klass == numo_cSFloat ? (ssize_t)sizeof(float) : (klass == numo_cInt32 ? (ssize_t)sizeof(int32_t) : (ssize_t)sizeof(double));
+    const char* ptr = na_get_pointer_for_read(x_val) + na_get_offset(x_val);
+    ssize_t stride = elem_size;
+    const size_t* index = NULL;
+    if (NA_TYPE(x_nary) == NARRAY_VIEW_T && NA_VIEW_STRIDX(x_nary) != NULL) {
+      const stridx_t stridx = NA_VIEW_STRIDX(x_nary)[0];
+      if (SDX_IS_INDEX(stridx)) {
+        index = SDX_GET_INDEX(stridx);
+      } else {
+        stride = SDX_GET_STRIDE(stridx);
+      }
+    }
+    if (klass == numo_cSFloat) {
+      n_nonzero_features = setCompiledModelNodes<float>(data->nodes, ptr, stride, index, (int)n_features);
+    } else if (klass == numo_cInt32) {
+      n_nonzero_features = setCompiledModelNodes<int32_t>(data->nodes, ptr, stride, index, (int)n_features);
+    } else {
+      n_nonzero_features = setCompiledModelNodes<double>(data->nodes, ptr, stride, index, (int)n_features);
+    }
+    RB_GC_GUARD(x_val);
+  }
+  data->nodes[n_nonzero_features].index = -1;
+  data->nodes[n_nonzero_features].value = 0.0;
+  return data->nodes;
+}
+
+static VALUE numo_libsvm_compiled_model_alloc(VALUE klass) {
+  CompiledModelData* data = ALLOC(CompiledModelData);
+  data->param = NULL;
+  data->model = NULL;
+  data->nodes = NULL;
+  data->n_nodes = 0;
+  data->dec_values = NULL;
+  data->scratch = NULL;
+  return TypedData_Wrap_Struct(klass, &compiledModelDataType, data);
+}
+
+static VALUE numo_libsvm_compiled_model_init(VALUE self, VALUE param_hash, VALUE model_hash) {
+  CompiledModelData* data;
+  TypedData_Get_Struct(self, CompiledModelData, &compiledModelDataType, data);
+  if (data->model != NULL) rb_raise(rb_eRuntimeError, "Compiled model is already initialized.");
+
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
+  model->param = *param;
+  LibSvmCompileParameter compile_param = convertHashToLibSvmCompileParameter(param_hash);
+  svm_compile_model(model, &compile_param);
+  // the compact copy of support vectors replaces their rows of nodes
+  if (!svm_compiled_model_needs_sv(model) && model->SV) {
+    for (int i = 0; i < model->l; i++) xfree(model->SV[i]);
+    xfree(model->SV);
+    model->SV = NULL;
+  }
+
+  const int nr_class = model->nr_class;
+  const bool is_classifier = param->svm_type == C_SVC || param->svm_type == NU_SVC;
+  const int n_dec_values = is_classifier ? nr_class * (nr_class - 1) / 2 : 1;
+  data->dec_values = ALLOC_N(double, n_dec_values > 0 ? n_dec_values : 1);
+  data->scratch = ALLOC_N(double, svm_predict_scratch_size(model));
+  data->param = param;
+  data->model = model;
+
+  return self;
+}
+
+static VALUE numo_libsvm_compiled_model_predict(VALUE self, VALUE x_val) {
+  CompiledModelData* data = getCompiledModelData(self);
+  const LibSvmNode* x = convertSampleToLibSvmNodes(data, x_val);
+  return DBL2NUM(svm_predict_scratch(data->model, x, data->scratch));
+}
+
+static VALUE numo_libsvm_compiled_model_decision_function(VALUE self, VALUE x_val) {
+  CompiledModelData* data = getCompiledModelData(self);
+  const LibSvmNode* x = convertSampleToLibSvmNodes(data, x_val);
+  svm_predict_values_scratch(data->model, x, data->dec_values, data->scratch);
+  const int nr_class = data->model->nr_class;
+  const int svm_type = data->param->svm_type;
+  if ((svm_type != C_SVC && svm_type != NU_SVC) || nr_class <= 2) return DBL2NUM(data->dec_values[0]);
+
+  const int n_dec_values = nr_class * (nr_class - 1) / 2;
+  VALUE dec_ary = rb_ary_new2(n_dec_values);
+  for (int k = 0; k < n_dec_values; k++) rb_ary_store(dec_ary, k, DBL2NUM(data->dec_values[k]));
+  return dec_ary;
+}
+
+static VALUE numo_libsvm_compiled_model_get_info(VALUE self) {
+  CompiledModelData* data = getCompiledModelData(self);
+  struct svm_compiled_model_info info;
+  svm_get_compiled_model_info(data->model, &info);
+  return convertLibSvmCompiledModelInfoToHash(&info);
+}
+
+/**
+ * Training run on a native thread by Numo::Libsvm.train_async. The training thread only calls svm_train and then
+ * sets done under the mutex, so that the problem and parameters are converted and the model is converted into a hash
+ * by Ruby threads holding the GVL.
+ */
+struct TrainingJobData {
+  LibSvmProblem* problem;
+  LibSvmParameter* param;
+  LibSvmModel* model;
+  struct svm_monitor monitor;
+  TelemetryRecorder recorder;
+  bool has_telemetry;
+  bool has_kernel_stats;
+  bool has_timing;
+  bool verbose;
+  struct svm_timing timing;
+  double convert_dataset_time;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool done;
+  VALUE model_hash;
+};
+
+struct TrainingJobWait {
+  TrainingJobData* job;
+  bool interrupted;
+};
+
+void runTrainingJob(TrainingJobData* job) {
+  // the print function of LIBSVM is set per thread
+  svm_set_print_string_function(job->verbose ? NULL : printNull);
+  LibSvmModel* model = svm_train(job->problem, job->param);
+  std::lock_guard<std::mutex> lock(job->mutex);
+  job->model = model;
+  job->done = true;
+  job->cond.notify_all();
+}
+
+bool isTrainingJobDone(TrainingJobData* job) {
+  std::lock_guard<std::mutex> lock(job->mutex);
+  return job->done;
+}
+
+void* waitTrainingJob(void* ptr) {
+  TrainingJobWait* wait = (TrainingJobWait*)ptr;
+  TrainingJobData* job = wait->job;
+  std::unique_lock<std::mutex> lock(job->mutex);
+  while (!job->done && !wait->interrupted) job->cond.wait(lock);
+  return NULL;
+}
+
+void interruptTrainingJobWait(void* ptr) {
+  TrainingJobWait* wait = (TrainingJobWait*)ptr;
+  std::lock_guard<std::mutex> lock(wait->job->mutex);
+  wait->interrupted = true;
+  wait->job->cond.notify_all();
+}
+
+void releaseTrainingJobData(TrainingJobData* job) {
+  if (job->thread.joinable()) job->thread.join();
+  if (job->model != NULL) {
+    svm_free_and_destroy_model(&job->model);
+    job->model = NULL;
+  }
+  deleteLibSvmProblem(job->problem);
+  job->problem = NULL;
+  deleteLibSvmParameter(job->param);
+  job->param = NULL;
+  std::vector<struct svm_telemetry>().swap(job->recorder.samples);
+  svm_free_timing(&job->timing);
+}
+
+void markTrainingJobData(void* ptr) { rb_gc_mark(((TrainingJobData*)ptr)->model_hash); }
+
+void freeTrainingJobData(void* ptr) {
+  TrainingJobData* job = (TrainingJobData*)ptr;
+  job->monitor.cancel.store(1, std::memory_order_relaxed);
+  releaseTrainingJobData(job);
+  delete job;
+}
+
+size_t sizeTrainingJobData(const void* ptr) { return sizeof(TrainingJobData); }
+
+const rb_data_type_t trainingJobDataType = {
+  "Numo::Libsvm::TrainingJob",
+  {markTrainingJobData, freeTrainingJobData, sizeTrainingJobData},
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+TrainingJobData* getTrainingJobData(VALUE self) {
+  TrainingJobData* job;
+  TypedData_Get_Struct(self, TrainingJobData, &trainingJobDataType, job);
+  return job;
+}
+
+static VALUE numo_libsvm_train_async(VALUE self, VALUE x_val, VALUE y_val, VALUE param_hash) {
+  if (!isNArrayMatrixClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
+  if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
+
+  narray_t* x_nary;
+  narray_t* y_nary;
+  GetNArray(x_val, x_nary);
+  GetNArray(y_val, y_nary);
+  if (NA_NDIM(x_nary) != 2) {
+    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
+    return Qnil;
+  }
+  if (NA_NDIM(y_nary) != 1) {
+    rb_raise(rb_eArgError, "Expect label or target values to be 1-D arrray.");
+    return Qnil;
+  }
+  if (NA_SHAPE(x_nary)[0] != NA_SHAPE(y_nary)[0]) {
+    rb_raise(rb_eArgError, "Expect to have the same number of samples for samples and labels.");
+    return Qnil;
+  }
+
+  struct svm_monitor monitor;
+  svm_init_monitor(&monitor);
+  TelemetryRecorder recorder;
+  const bool has_telemetry = setTelemetryRecorder(param_hash, &monitor, &recorder, false);
+  // without a seed, the generator of the job is seeded from rand() here, on the thread holding the GVL
+  if (!setRandomSeed(param_hash, &monitor)) {
+    monitor.has_rng = 1;
+    monitor.rng = (unsigned int)rand();
+  }
+
+  const double t = getMonotonicTime();
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  LibSvmProblem* problem = convertDatasetToLibSvmProblem(x_val, y_val);
+  const double convert_dataset_time = getMonotonicTime() - t;
+
+  const char* err_msg = svm_check_parameter(problem, param);
+  if (err_msg) {
+    deleteLibSvmProblem(problem);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
+    return Qnil;
+  }
+
+  TrainingJobData* job = new TrainingJobData();
+  job->problem = problem;
+  job->param = param;
+  job->model = NULL;
+  svm_init_monitor(&job->monitor);
+  job->monitor.active_size.store(problem->l, std::memory_order_relaxed);
+  job->monitor.nr_subproblem.store(1, std::memory_order_relaxed);
+  job->monitor.has_rng = monitor.has_rng;
+  job->monitor.rng = monitor.rng;
+  job->monitor.telemetry_interval = monitor.telemetry_interval;
+  job->monitor.telemetry = monitor.telemetry;
+  job->recorder.callback = Qnil;
+  job->recorder.state = 0;
+  job->recorder.monitor = &job->monitor;
+  job->monitor.telemetry_data = &job->recorder;
+  job->has_telemetry = has_telemetry;
+  job->has_kernel_stats = RTEST(rb_hash_aref(param_hash, ID2SYM(rb_intern("kernel_stats"))));
+  job->has_timing = RTEST(rb_hash_aref(param_hash, ID2SYM(rb_intern("timing"))));
+  job->verbose = RTEST(rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose"))));
+  job->convert_dataset_time = convert_dataset_time;
+  if (job->has_timing) job->monitor.timing = &job->timing;
+  job->done = false;
+  job->model_hash = Qnil;
+  param->monitor = &job->monitor;
+  VALUE job_val = TypedData_Wrap_Struct(rb_path2class("Numo::Libsvm::TrainingJob"), &trainingJobDataType, job);
+  try {
+    job->thread = std::thread(runTrainingJob, job);
+  } catch (const std::system_error&) {
+    job->done = true;
+    rb_raise(rb_eRuntimeError, "Failed to start a training thread.");
+    return Qnil;
+  }
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(y_val);
+
+  return job_val;
+}
+
+static VALUE numo_libsvm_training_job_wait(VALUE self) {
+  TrainingJobData* job = getTrainingJobData(self);
+  while (!isTrainingJobDone(job)) {
+    TrainingJobWait wait = {job, false};
+    rb_thread_call_without_gvl(waitTrainingJob, &wait, interruptTrainingJobWait, &wait);
+    rb_thread_check_ints();
+  }
+  if (NIL_P(job->model_hash)) {
+    if (job->thread.joinable()) job->thread.join();
+    const double t = getMonotonicTime();
+    VALUE model_hash = convertLibSvmModelToHash(job->model);
+    const double convert_model_time = getMonotonicTime() - t;
+    if (job->has_telemetry) rb_hash_aset(model_hash, ID2SYM(rb_intern("telemetry")), convertTelemetryRecorderToArray(&job->recorder));
+    if (job->has_kernel_stats) {
+      rb_hash_aset(model_hash, ID2SYM(rb_intern("kernel_stats")), convertLibSvmKernelStatsToHash(&job->monitor.kernel_stats));
+    }
+    if (job->has_timing) {
+      rb_hash_aset(model_hash, ID2SYM(rb_intern("timing")),
+                   convertLibSvmTimingToHash(&job->timing, job->convert_dataset_time, convert_model_time));
+    }
+    job->model_hash = model_hash;
+    releaseTrainingJobData(job);
+  }
+  return job->model_hash;
+}
+
+static VALUE numo_libsvm_training_job_is_done(VALUE self) { return isTrainingJobDone(getTrainingJobData(self)) ? Qtrue : Qfalse; }
+
+static VALUE numo_libsvm_training_job_cancel(VALUE self) {
+  getTrainingJobData(self)->monitor.cancel.store(1, std::memory_order_relaxed);
+  return self;
+}
+
+static VALUE numo_libsvm_training_job_is_cancelled(VALUE self) { return getTrainingJobData(self)->monitor.cancel.load(std::memory_order_relaxed) ? Qtrue : Qfalse; }
+
+static VALUE numo_libsvm_training_job_progress(VALUE self) {
+  const struct svm_monitor& monitor = getTrainingJobData(self)->monitor;
+  VALUE progress_hash = rb_hash_new();
+  rb_hash_aset(progress_hash, ID2SYM(rb_intern("iter")), INT2NUM(monitor.iter.load(std::memory_order_relaxed)));
+  rb_hash_aset(progress_hash, ID2SYM(rb_intern("obj")), DBL2NUM(monitor.obj.load(std::memory_order_relaxed)));
+  rb_hash_aset(progress_hash, ID2SYM(rb_intern("active_size")), INT2NUM(monitor.active_size.load(std::memory_order_relaxed)));
+  rb_hash_aset(progress_hash, ID2SYM(rb_intern("subproblem")), INT2NUM(monitor.subproblem.load(std::memory_order_relaxed)));
+  rb_hash_aset(progress_hash, ID2SYM(rb_intern("nr_subproblem")), INT2NUM(monitor.nr_subproblem.load(std::memory_order_relaxed)));
+  return progress_hash;
+}
+
 #endif /* LIBSVMEXT_HPP */
@@ -7,6 +7,8 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <locale.h>
+#include <chrono>
+#include <new>
 #include "svm.h"
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
@@ -34,16 +36,37 @@ static inline double powi(double base, int times)
 	}
 	return ret;
 }
+// OpenMP directives, left out without -fopenmp so that the pragmas are not
+// reported as unknown
+#ifdef _OPENMP
+#define SVM_OMP(directive) _Pragma(#directive)
+#else
+#define SVM_OMP(directive)
+#endif
 #define INF HUGE_VAL
 #define TAU 1e-12
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 
+// Static probes of the libsvm provider for bpftrace, perf and SystemTap,
+// compiled in with LIBSVM_SDT (--enable-sdt). Each is a nop when not traced.
+#ifdef LIBSVM_SDT
+#include <sys/sdt.h>
+#define SVM_PROBE1(name,a) DTRACE_PROBE1(libsvm,name,a)
+#define SVM_PROBE2(name,a,b) DTRACE_PROBE2(libsvm,name,a,b)
+#define SVM_PROBE3(name,a,b,c) DTRACE_PROBE3(libsvm,name,a,b,c)
+#else
+#define SVM_PROBE1(name,a)
+#define SVM_PROBE2(name,a,b)
+#define SVM_PROBE3(name,a,b,c)
+#endif
+
 static void print_string_stdout(const char *s)
 {
 	fputs(s,stdout);
 	fflush(stdout);
 }
-static void (*svm_print_string) (const char *) = &print_string_stdout;
+// per thread, so that training on another thread keeps its own output
+static thread_local void (*svm_print_string) (const char *) = &print_string_stdout;
 #if 1
 static void info(const char *fmt,...)
 {
@@ -58,6 +81,114 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+// seconds of a monotonic clock, for the time budget of training
+static double wall_time()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// whether training should stop because it is cancelled or out of time
+static bool is_training_stopped(const svm_monitor *monitor)
+{
+	return monitor != NULL &&
+		(monitor->cancel.load(std::memory_order_relaxed) ||
+		 (monitor->deadline > 0 && wall_time() >= monitor->deadline));
+}
+
+// random numbers of training, from the generator of the monitor if it has
+// one (a 64-bit LCG, so that jobs on other threads do not share rand())
+static int svm_rand(const svm_parameter *param)
+{
+	svm_monitor *monitor = param->monitor;
+	if(monitor == NULL || !monitor->has_rng)
+		return rand();
+	monitor->rng = monitor->rng*6364136223846793005ULL + 1442695040888963407ULL;
+	return (int)(monitor->rng >> 33);
+}
+
+//
+// exp and tanh over arrays, for kernel columns and predictions
+//
+// Unless LIBSVM_STRICT_LIBM is defined, exp is computed by a branch-free
+// approximation that the compiler can vectorize: x = n*ln2 + r, |r| <= ln2/2,
+// exp(r) by its Taylor polynomial of degree 13, and 2^n by setting the
+// exponent bits. The relative error is within 1 ulp in [-708,709]; arguments
+// outside of it are passed to exp(). tanh(x) is 1 - 2/(exp(2x)+1), with an
+// absolute error below 4e-16.
+// With LIBSVM_STRICT_LIBM, the libm functions are called for each element
+// and the results are bitwise identical to evaluating kernels one by one.
+//
+#ifndef LIBSVM_STRICT_LIBM
+static inline double exp_poly(double x)
+{
+	const double shift = 6755399441055744.0;	// 1.5*2^52, rounds t to an integer
+	double t = x*1.4426950408889634 + shift;
+	double n = t - shift;
+	double r = x - n*6.93147180369123816490e-01 - n*1.90821492927058770002e-10;
+	double p = 1.0/6227020800.0;
+	p = p*r + 1.0/479001600.0;
+	p = p*r + 1.0/39916800.0;
+	p = p*r + 1.0/3628800.0;
+	p = p*r + 1.0/362880.0;
+	p = p*r + 1.0/40320.0;
+	p = p*r + 1.0/5040.0;
+	p = p*r + 1.0/720.0;
+	p = p*r + 1.0/120.0;
+	p = p*r + 1.0/24.0;
+	p = p*r + 1.0/6.0;
+	p = p*r + 0.5;
+	p = p*r + 1.0;
+	p = p*r + 1.0;
+	unsigned long long bits;	// the low bits of t hold n
+	memcpy(&bits,&t,sizeof(bits));
+	bits = (bits + 1023) << 52;
+	double scale;
+	memcpy(&scale,&bits,sizeof(scale));
+	return p*scale;
+}
+#endif
+
+#define VALUES_CHUNK 256
+#define FILL_PARALLEL_MIN 2048
+static void exp_values(double *v, int n)
+{
+#ifdef LIBSVM_STRICT_LIBM
+	for(int i=0;i<n;i++)
+		v[i] = exp(v[i]);
+#else
+	double x[VALUES_CHUNK];
+	for(int s=0;s<n;s+=VALUES_CHUNK)
+	{
+		int k, m = min(n-s,VALUES_CHUNK);
+		double *w = &v[s];
+		for(k=0;k<m;k++)
+			x[k] = w[k];
+SVM_OMP(omp simd)
+		for(k=0;k<m;k++)
+			w[k] = exp_poly(x[k]);
+		for(k=0;k<m;k++)
+			if(!(x[k] >= -708.0 && x[k] <= 709.0))
+				w[k] = exp(x[k]);
+	}
+#endif
+}
+
+static void tanh_values(double *v, int n)
+{
+	int i;
+#ifdef LIBSVM_STRICT_LIBM
+	for(i=0;i<n;i++)
+		v[i] = tanh(v[i]);
+#else
+	for(i=0;i<n;i++)
+		v[i] *= 2;
+	exp_values(v,n);
+SVM_OMP(omp simd)
+	for(i=0;i<n;i++)
+		v[i] = 1 - 2/(v[i]+1);
+#endif
+}
+
 //
 // Kernel Cache
 //
@@ -75,9 +206,14 @@ public:
 	// (p >= len if nothing needs to be filled)
 	int get_data(const int index, Qfloat **data, int len);
 	void swap_index(int i, int j);
+
+	// counters for svm_kernel_stats
+	long long nr_hit, nr_miss, nr_evict;
+	long int max_used;	// largest number of Qfloats cached at once
 private:
 	int l;
 	long int size;
+	long int capacity;
 	struct head_t
 	{
 		head_t *prev, *next;	// a circular list
@@ -97,7 +233,10 @@ Cache::Cache(int l_,long int size_):l(l_),size(size_)
 	size /= sizeof(Qfloat);
 	size -= l * sizeof(head_t) / sizeof(Qfloat);
 	size = max(size, 2 * (long int) l);	// cache must be large enough for two columns
+	capacity = size;
 	lru_head.next = lru_head.prev = &lru_head;
+	nr_hit = nr_miss = nr_evict = 0;
+	max_used = 0;
 }
 
 Cache::~Cache()
@@ -131,6 +270,8 @@ int Cache::get_data(const int index, Qfloat **data, int len)
 
 	if(more > 0)
 	{
+		++nr_miss;
+		SVM_PROBE3(cache__miss,index,len,more);
 		// free old space
 		while(size < more)
 		{
@@ -140,13 +281,17 @@ int Cache::get_data(const int index, Qfloat **data, int len)
 			size += old->len;
 			old->data = 0;
 			old->len = 0;
+			++nr_evict;
 		}
 
 		// allocate new space
 		h->data = (Qfloat *)realloc(h->data,sizeof(Qfloat)*len);
 		size -= more;
+		max_used = max(max_used,capacity-size);
 		swap(h->len,len);
 	}
+	else
+		++nr_hit;
 
 	lru_insert(h);
 	*data = h->data;
@@ -179,6 +324,7 @@ void Cache::swap_index(int i, int j)
 				size += h->len;
 				h->data = 0;
 				h->len = 0;
+				++nr_evict;
 			}
 		}
 	}
@@ -191,6 +337,12 @@ void Cache::swap_index(int i, int j)
 // the constructor of Kernel prepares to calculate the l*l kernel matrix
 // the member function get_Q is for getting one column from the Q Matrix
 //
+// kernels are templates on the kernel type and on the storage of x (sparse
+// rows of separate index and value arrays, or a dense copy if the data is
+// dense enough); the routine
+// filling a column is selected once in the constructor, so the kernel is
+// inlined into the loop over the column
+//
 class QMatrix {
 public:
 	virtual Qfloat *get_Q(int column, int len) const = 0;
@@ -199,6 +351,8 @@ public:
 	virtual ~QMatrix() {}
 };
 
+enum { SPARSE, DENSE };	/* storage of x in Kernel */
+
 class Kernel: public QMatrix {
 public:
 	Kernel(int l, svm_node * const * x, const svm_parameter& param);
@@ -206,20 +360,76 @@ public:
 
 	static double k_function(const svm_node *x, const svm_node *y,
 				 const svm_parameter& param);
+	// kvalue[i] = k_function(x,SV[i],param) for i in [0,l); for RBF,
+	// ||x-SV[i]||^2 is expanded with SV_square[i] = ||SV[i]||^2 if given
+	static void k_function_values(const svm_node *x, const svm_node * const *SV, int l,
+				      const svm_parameter& param, double *kvalue,
+				      const double *SV_square = NULL);
+	static double dot(const svm_node *px, const svm_node *py);
+	template<class T> static double dot(const T *px, const T *py, int n);
+	static double dot(const int *pi, const svm_value *pv, int n, const int *qi, const svm_value *qv, int m);
+	static double squared_distance(const svm_node *x, const svm_node *y);
 	virtual Qfloat *get_Q(int column, int len) const = 0;
 	virtual double *get_QD() const = 0;
 	virtual void swap_index(int i, int j) const	// no so const...
 	{
 		swap(x[i],x[j]);
+		if(x_dense) swap(x_dense[i],x_dense[j]);
+		if(x_index)
+		{
+			swap(x_index[i],x_index[j]);
+			swap(x_value[i],x_value[j]);
+			swap(x_nnz[i],x_nnz[j]);
+		}
 		if(x_square) swap(x_square[i],x_square[j]);
 	}
 protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
+	// fill data[start,len) of column i, multiplied by y[i]*y[j] if y is given
+	void (Kernel::*fill_column)(int i, Qfloat *data, int start, int len, const schar *y) const;
+
+	// the whole l*l matrix, used instead of Cache when it fits in cache_size
+	Qfloat **Q_full;
+	bool fill_full_Q(int l, long int size, const schar *y);
+	void free_full_Q();
+	void swap_full_Q(int i, int j) const;
+
+	// counters added to the kernel_stats of the monitor, if any, on destruction
+	svm_monitor *monitor;
+	mutable long long nr_eval;
+	mutable double fill_time;
+	void fill_Q_column(int i, Qfloat *data, int start, int len, const schar *y) const
+	{
+		if(!monitor)
+		{
+			(this->*fill_column)(i,data,start,len,y);
+			return;
+		}
+		double t = wall_time();
+		(this->*fill_column)(i,data,start,len,y);
+		fill_time += wall_time()-t;
+		nr_eval += len-start;
+	}
+	void add_cache_stats(const Cache *cache) const;
 
 private:
 	const svm_node **x;
+	svm_value **x_dense;	// rows of the dense copy of x, NULL if stored sparse
+	svm_value *dense_data;
+	// rows of x stored sparse, as separate index and value arrays without
+	// the terminating -1, NULL if stored densely or precomputed
+	const int **x_index;
+	const svm_value **x_value;
+	int *x_nnz;
+	int *index_data;
+	svm_value *value_data;
+	int dim;		// largest feature index, 0 if an index is below 1
+	long int nr_nonzero;
 	double *x_square;
+	double *values;		// buffer for a column of exp/tanh arguments
+	int full_l;
+	Qfloat *full_data;
 
 	// svm_parameter
 	const int kernel_type;
@@ -227,68 +437,419 @@ private:
 	const double gamma;
 	const double coef0;
 
-	static double dot(const svm_node *px, const svm_node *py);
-	double kernel_linear(int i, int j) const
+	// argument of exp (RBF) or tanh (SIGMOID) from the dot product of x[i] and x[j]
+	template<int KT> double kernel_arg(double dot, int i, int j) const
+	{
+		if(KT == RBF)
+			return -gamma*(x_square[i]+x_square[j]-2*dot);
+		return gamma*dot+coef0;
+	}
+	// kernel value of x[i] and x[j] from their dot product
+	template<int KT> double kernel_dot(double dot, int i, int j) const
+	{
+		switch(KT)
+		{
+			case LINEAR:
+				return dot;
+			case POLY:
+				return powi(gamma*dot+coef0,degree);
+			case RBF:
+				return exp(kernel_arg<RBF>(dot,i,j));
+			case SIGMOID:
+				return tanh(kernel_arg<SIGMOID>(dot,i,j));
+			default:
+				return 0;  // Unreachable
+		}
+	}
+	template<int S> double dot(int i, int j) const
 	{
-		return dot(x[i],x[j]);
+		if(S == DENSE)
+			return dot(x_dense[i],x_dense[j],dim);
+		return dot(x_index[i],x_value[i],x_nnz[i],x_index[j],x_value[j],x_nnz[j]);
 	}
-	double kernel_poly(int i, int j) const
+	template<int KT, int S> double kernel(int i, int j) const
 	{
-		return powi(gamma*dot(x[i],x[j])+coef0,degree);
+		if(KT == PRECOMPUTED)
+			return x[i][(int)(x[j][0].value)].value;
+		return kernel_dot<KT>(dot<S>(i,j),i,j);
 	}
-	double kernel_rbf(int i, int j) const
+	template<int KT, int S> void fill(int i, Qfloat *data, int start, int len, const schar *y) const
 	{
-		return exp(-gamma*(x_square[i]+x_square[j]-2*dot(x[i],x[j])));
+		// chunks of a column are computed by the OpenMP threads if it is
+		// long enough; they are independent, so results do not change
+SVM_OMP(omp parallel for schedule(static) if(len-start >= FILL_PARALLEL_MIN))
+		for(int s=start;s<len;s+=VALUES_CHUNK)
+			fill_chunk<KT,S>(i,data,s,min(s+VALUES_CHUNK,len),y);
 	}
-	double kernel_sigmoid(int i, int j) const
+	template<int KT, int S> void fill_chunk(int i, Qfloat *data, int start, int len, const schar *y) const
 	{
-		return tanh(gamma*dot(x[i],x[j])+coef0);
+		int j;
+		if(KT == RBF || KT == SIGMOID)
+		{
+			// arguments first, then exp or tanh over the whole chunk
+			for(j=start;j<len;j++)
+				values[j] = kernel_arg<KT>(dot<S>(i,j),i,j);
+			if(KT == RBF)
+				exp_values(&values[start],len-start);
+			else
+				tanh_values(&values[start],len-start);
+			if(y)
+				for(j=start;j<len;j++)
+					data[j] = (Qfloat)(y[i]*y[j]*values[j]);
+			else
+				for(j=start;j<len;j++)
+					data[j] = (Qfloat)values[j];
+			return;
+		}
+		if(y)
+			for(j=start;j<len;j++)
+				data[j] = (Qfloat)(y[i]*y[j]*kernel<KT,S>(i,j));
+		else
+			for(j=start;j<len;j++)
+				data[j] = (Qfloat)kernel<KT,S>(i,j);
 	}
-	double kernel_precomputed(int i, int j) const
+	template<int KT, int S> void select_kernel()
 	{
-		return x[i][(int)(x[j][0].value)].value;
+		kernel_function = &Kernel::kernel<KT,S>;
+		fill_column = &Kernel::fill<KT,S>;
 	}
+	template<int KT> void fill_tile(int i0, int i1, int j0, int j1, double *dots,
+					const schar *y) const;
+	template<int KT> static double k_function(const svm_node *x, const svm_node *y,
+						  const svm_parameter& param);
+	template<int KT> static void k_function_values(const svm_node *x, const svm_node * const *SV,
+						       int l, const svm_parameter& param, double *kvalue,
+						       const double *SV_square);
 };
 
 Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 :kernel_type(param.kernel_type), degree(param.degree),
  gamma(param.gamma), coef0(param.coef0)
 {
+	clone(x,x_,l);
+	monitor = param.monitor;
+	nr_eval = 0;
+	fill_time = 0;
+
+	int i;
+	dim = 0;
+	nr_nonzero = 0;
+	bool dense_index = true;
+	if(kernel_type != PRECOMPUTED)
+		for(i=0;i<l;i++)
+			for(const svm_node *px = x[i]; px->index != -1; ++px)
+			{
+				dim = max(dim,px->index);
+				dense_index = dense_index && px->index >= 1;
+				++nr_nonzero;
+			}
+	// a dense copy has no place for indices below 1, so such x stay sparse
+	if(!dense_index)
+		dim = 0;
+
+	// store x densely if it takes no more memory than svm_node rows
+	x_dense = 0;
+	dense_data = 0;
+	if(dim > 0 && (double)l*dim*sizeof(svm_value) <= (double)nr_nonzero*sizeof(svm_node))
+	{
+		dense_data = new svm_value[(size_t)l*dim];
+		memset(dense_data,0,sizeof(svm_value)*(size_t)l*dim);
+		x_dense = new svm_value*[l];
+		for(i=0;i<l;i++)
+		{
+			x_dense[i] = &dense_data[(size_t)i*dim];
+			for(const svm_node *px = x[i]; px->index != -1; ++px)
+				x_dense[i][px->index-1] = px->value;
+		}
+	}
+
+	// otherwise as index and value arrays, which dot() reads with 12 bytes
+	// per nonzero instead of 16 for an svm_node
+	x_index = 0;
+	x_value = 0;
+	x_nnz = 0;
+	index_data = 0;
+	value_data = 0;
+	if(!x_dense && kernel_type != PRECOMPUTED)
+	{
+		index_data = new int[nr_nonzero > 0 ? nr_nonzero : 1];
+		value_data = new svm_value[nr_nonzero > 0 ? nr_nonzero : 1];
+		x_index = new const int*[l];
+		x_value = new const svm_value*[l];
+		x_nnz = new int[l];
+		long int k = 0;
+		for(i=0;i<l;i++)
+		{
+			x_index[i] = &index_data[k];
+			x_value[i] = &value_data[k];
+			for(const svm_node *px = x[i]; px->index != -1; ++px, ++k)
+			{
+				index_data[k] = px->index;
+				value_data[k] = px->value;
+			}
+			x_nnz[i] = (int)(&index_data[k]-x_index[i]);
+		}
+	}
+
 	switch(kernel_type)
 	{
 		case LINEAR:
-			kernel_function = &Kernel::kernel_linear;
+			if(x_dense) select_kernel<LINEAR,DENSE>(); else select_kernel<LINEAR,SPARSE>();
 			break;
 		case POLY:
-			kernel_function = &Kernel::kernel_poly;
+			if(x_dense) select_kernel<POLY,DENSE>(); else select_kernel<POLY,SPARSE>();
 			break;
 		case RBF:
-			kernel_function = &Kernel::kernel_rbf;
+			if(x_dense) select_kernel<RBF,DENSE>(); else select_kernel<RBF,SPARSE>();
 			break;
 		case SIGMOID:
-			kernel_function = &Kernel::kernel_sigmoid;
+			if(x_dense) select_kernel<SIGMOID,DENSE>(); else select_kernel<SIGMOID,SPARSE>();
 			break;
 		case PRECOMPUTED:
-			kernel_function = &Kernel::kernel_precomputed;
+			select_kernel<PRECOMPUTED,SPARSE>();
 			break;
 	}
 
-	clone(x,x_,l);
-
 	if(kernel_type == RBF)
 	{
 		x_square = new double[l];
-		for(int i=0;i<l;i++)
-			x_square[i] = dot(x[i],x[i]);
+		for(i=0;i<l;i++)
+			x_square[i] = x_dense ? dot(x_dense[i],x_dense[i],dim) : dot(x[i],x[i]);
 	}
 	else
 		x_square = 0;
+
+	values = new double[l];
+
+	Q_full = 0;
+	full_data = 0;
+	full_l = 0;
 }
 
 Kernel::~Kernel()
 {
+	if(monitor)
+	{
+		monitor->kernel_stats.train_kernel_evaluations += nr_eval;
+		monitor->kernel_stats.fill_time += fill_time;
+	}
 	delete[] x;
+	delete[] x_dense;
+	delete[] dense_data;
+	delete[] x_index;
+	delete[] x_value;
+	delete[] x_nnz;
+	delete[] index_data;
+	delete[] value_data;
 	delete[] x_square;
+	delete[] values;
+	free_full_Q();
+}
+
+void Kernel::add_cache_stats(const Cache *cache) const
+{
+	if(!monitor || !cache)
+		return;
+	svm_kernel_stats& stats = monitor->kernel_stats;
+	stats.cache_hits += cache->nr_hit;
+	stats.cache_misses += cache->nr_miss;
+	stats.cache_evictions += cache->nr_evict;
+	stats.cache_bytes = max(stats.cache_bytes,(long long)cache->max_used*(long long)sizeof(Qfloat));
+}
+
+//
+// Compute the whole kernel matrix at once if l*l Qfloats fit in size bytes
+// and can be allocated; otherwise false is returned and the caller uses the
+// LRU cache (no allocation here throws through the C API).
+// The matrix is built in square tiles so that both row blocks stay in cache,
+// and the upper triangle is mirrored. If the data is dense enough, the dot
+// products of a tile are computed as a blocked matrix product over dense
+// rows of x; the summation order is the same as in dot(), so the values do
+// not differ from those computed column by column.
+// Q_full[i] is then column i of Q (rows and columns are swapped together).
+//
+#define KERNEL_TILE 64
+bool Kernel::fill_full_Q(int l, long int size, const schar *y)
+{
+	if(l <= 0 || (double)l*l*sizeof(Qfloat) > (double)size)
+		return false;
+
+	double start_time = monitor ? wall_time() : 0;
+	full_data = new (std::nothrow) Qfloat[(size_t)l*l];
+	Q_full = new (std::nothrow) Qfloat*[l];
+	if(!full_data || !Q_full)
+	{
+		free_full_Q();
+		return false;
+	}
+	full_l = l;
+	int i;
+	for(i=0;i<l;i++)
+		Q_full[i] = &full_data[(size_t)i*l];
+
+	// use a temporary dense copy if it is smaller than Q and not too sparse
+	const svm_value * const *rows = x_dense;
+	int d = dim;
+	svm_value *dense = NULL;
+	svm_value **dense_rows = NULL;
+	if(!rows && d > 0 && 2*(long int)d <= l && 10*nr_nonzero >= (long int)l*d)
+	{
+		dense = new (std::nothrow) svm_value[(size_t)l*d];
+		dense_rows = new (std::nothrow) svm_value*[l];
+	}
+	if(dense && dense_rows)
+	{
+		memset(dense,0,sizeof(svm_value)*(size_t)l*d);
+		for(i=0;i<l;i++)
+		{
+			dense_rows[i] = &dense[(size_t)i*d];
+			for(const svm_node *px = x[i]; px->index != -1; ++px)
+				dense_rows[i][px->index-1] = px->value;
+		}
+		rows = dense_rows;
+	}
+
+	int nr_tile = (l+KERNEL_TILE-1)/KERNEL_TILE;
+	// a thread without its buffers skips its tiles, and the matrix is dropped
+	int filled = 1;
+SVM_OMP(omp parallel reduction(&&:filled))
+	{
+		double *dots = new (std::nothrow) double[KERNEL_TILE*KERNEL_TILE];
+		double *xt = rows ? new (std::nothrow) double[(size_t)d*KERNEL_TILE] : NULL;
+		filled = dots != NULL && (xt != NULL || !rows);
+
+SVM_OMP(omp for schedule(dynamic))
+		for(int t=0;t<nr_tile*nr_tile;t++)
+		{
+			int ti = t/nr_tile, tj = t%nr_tile;
+			if(ti > tj || !filled)
+				continue;
+			int i0 = ti*KERNEL_TILE, i1 = min(i0+KERNEL_TILE,l);
+			int j0 = tj*KERNEL_TILE, j1 = min(j0+KERNEL_TILE,l);
+			int nj = j1-j0;
+			int ii, jj, k;
+
+			if(kernel_type == PRECOMPUTED)
+			{
+				for(ii=i0;ii<i1;ii++)
+					for(jj=max(j0,ii);jj<j1;jj++)
+					{
+						Q_full[ii][jj] = (Qfloat)((y ? y[ii]*y[jj] : 1)*kernel<PRECOMPUTED,SPARSE>(ii,jj));
+						Q_full[jj][ii] = (Qfloat)((y ? y[ii]*y[jj] : 1)*kernel<PRECOMPUTED,SPARSE>(jj,ii));
+					}
+				continue;
+			}
+
+			if(rows)
+			{
+				for(k=0;k<d;k++)
+					for(jj=0;jj<nj;jj++)
+						xt[k*nj+jj] = rows[j0+jj][k];
+				for(ii=i0;ii<i1;ii++)
+				{
+					double *dots_i = &dots[(ii-i0)*KERNEL_TILE];
+					const svm_value *x_i = rows[ii];
+					for(jj=0;jj<nj;jj++)
+						dots_i[jj] = 0;
+					for(k=0;k<d;k++)
+					{
+						double x_ik = x_i[k];
+						if(x_ik != 0)
+						{
+							const double *xt_k = &xt[k*nj];
+							for(jj=0;jj<nj;jj++)
+								dots_i[jj] += x_ik * xt_k[jj];
+						}
+					}
+				}
+			}
+			else
+			{
+				for(ii=i0;ii<i1;ii++)
+					for(jj=max(j0,ii);jj<j1;jj++)
+						dots[(ii-i0)*KERNEL_TILE+jj-j0] = dot<SPARSE>(ii,jj);
+			}
+
+			switch(kernel_type)
+			{
+				case LINEAR:
+					fill_tile<LINEAR>(i0,i1,j0,j1,dots,y);
+					break;
+				case POLY:
+					fill_tile<POLY>(i0,i1,j0,j1,dots,y);
+					break;
+				case RBF:
+					fill_tile<RBF>(i0,i1,j0,j1,dots,y);
+					break;
+				case SIGMOID:
+					fill_tile<SIGMOID>(i0,i1,j0,j1,dots,y);
+					break;
+			}
+		}
+
+		delete[] dots;
+		delete[] xt;
+	}
+
+	delete[] dense;
+	delete[] dense_rows;
+	if(!filled)
+	{
+		free_full_Q();
+		return false;
+	}
+	if(monitor)
+	{
+		// the upper triangle is computed and mirrored
+		nr_eval += (long long)l*(l+1)/2;
+		fill_time += wall_time()-start_time;
+		monitor->kernel_stats.cache_bytes = max(monitor->kernel_stats.cache_bytes,(long long)l*l*(long long)sizeof(Qfloat));
+	}
+	return true;
+}
+
+// store the kernel values of a tile from the dot products in dots
+void Kernel::free_full_Q()
+{
+	delete[] Q_full;
+	delete[] full_data;
+	Q_full = 0;
+	full_data = 0;
+}
+
+template<int KT> void Kernel::fill_tile(int i0, int i1, int j0, int j1, double *dots,
+					const schar *y) const
+{
+	for(int i=i0;i<i1;i++)
+	{
+		int j, j_start = max(j0,i), n = j1-j_start;
+		double *v = &dots[(i-i0)*KERNEL_TILE+j_start-j0];
+		if(KT == RBF || KT == SIGMOID)
+		{
+			for(j=0;j<n;j++)
+				v[j] = kernel_arg<KT>(v[j],i,j_start+j);
+			if(KT == RBF)
+				exp_values(v,n);
+			else
+				tanh_values(v,n);
+		}
+		else
+			for(j=0;j<n;j++)
+				v[j] = kernel_dot<KT>(v[j],i,j_start+j);
+		for(j=0;j<n;j++)
+		{
+			double k = v[j];
+			if(y) k *= y[i]*y[j_start+j];
+			Q_full[i][j_start+j] = Q_full[j_start+j][i] = (Qfloat)k;
+		}
+	}
+}
+
+void Kernel::swap_full_Q(int i, int j) const
+{
+	swap(Q_full[i],Q_full[j]);
+	for(int k=0;k<full_l;k++)
+		swap(Q_full[k][i],Q_full[k][j]);
 }
 
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -298,7 +859,7 @@ double Kernel::dot(const svm_node *px, const svm_node *py)
 	{
 		if(px->index == py->index)
 		{
-			sum += px->value * py->value;
+			sum += (double)px->value * py->value;
 			++px;
 			++py;
 		}
@@ -313,56 +874,87 @@ double Kernel::dot(const svm_node *px, const svm_node *py)
 	return sum;
 }
 
-double Kernel::k_function(const svm_node *x, const svm_node *y,
-			  const svm_parameter& param)
+double Kernel::dot(const int *pi, const svm_value *pv, int n, const int *qi, const svm_value *qv, int m)
 {
-	switch(param.kernel_type)
+	// the merge advances without branching on the order of the indices,
+	// which is unpredictable
+	double sum = 0;
+	int s = 0, t = 0;
+	while(s < n && t < m)
 	{
-		case LINEAR:
-			return dot(x,y);
-		case POLY:
-			return powi(param.gamma*dot(x,y)+param.coef0,param.degree);
-		case RBF:
+		int a = pi[s], b = qi[t];
+		if(a == b)
+			sum += (double)pv[s] * qv[t];
+		s += (a <= b);
+		t += (a >= b);
+	}
+	return sum;
+}
+
+template<class T> double Kernel::dot(const T *px, const T *py, int n)
+{
+	double sum = 0;
+#ifndef LIBSVM_STRICT_LIBM
+SVM_OMP(omp simd reduction(+:sum))
+#endif
+	for(int k=0;k<n;k++)
+		sum += (double)px[k] * py[k];
+	return sum;
+}
+
+double Kernel::squared_distance(const svm_node *x, const svm_node *y)
+{
+	double sum = 0;
+	while(x->index != -1 && y->index !=-1)
+	{
+		if(x->index == y->index)
 		{
-			double sum = 0;
-			while(x->index != -1 && y->index !=-1)
+			double d = (double)x->value - y->value;
+			sum += d*d;
+			++x;
+			++y;
+		}
+		else
+		{
+			if(x->index > y->index)
 			{
-				if(x->index == y->index)
-				{
-					double d = x->value - y->value;
-					sum += d*d;
-					++x;
-					++y;
-				}
-				else
-				{
-					if(x->index > y->index)
-					{
-						sum += y->value * y->value;
-						++y;
-					}
-					else
-					{
-						sum += x->value * x->value;
-						++x;
-					}
-				}
+				sum += (double)y->value * y->value;
+				++y;
 			}
-
-			while(x->index != -1)
+			else
 			{
-				sum += x->value * x->value;
+				sum += (double)x->value * x->value;
 				++x;
 			}
+		}
+	}
 
-			while(y->index != -1)
-			{
-				sum += y->value * y->value;
-				++y;
-			}
+	while(x->index != -1)
+	{
+		sum += (double)x->value * x->value;
+		++x;
+	}
 
-			return exp(-param.gamma*sum);
-		}
+	while(y->index != -1)
+	{
+		sum += (double)y->value * y->value;
+		++y;
+	}
+
+	return sum;
+}
+
+template<int KT> double Kernel::k_function(const svm_node *x, const svm_node *y,
+					   const svm_parameter& param)
+{
+	switch(KT)
+	{
+		case LINEAR:
+			return dot(x,y);
+		case POLY:
+			return powi(param.gamma*dot(x,y)+param.coef0,param.degree);
+		case RBF:
+			return exp(-param.gamma*squared_distance(x,y));
 		case SIGMOID:
 			return tanh(param.gamma*dot(x,y)+param.coef0);
 		case PRECOMPUTED:  //x: test (validation), y: SV
@@ -372,46 +964,148 @@ double Kernel::k_function(const svm_node *x, const svm_node *y,
 	}
 }
 
-// An SMO algorithm in Fan et al., JMLR 6(2005), p. 1889--1918
-// Solves:
-//
-//	min 0.5(\alpha^T Q \alpha) + p^T \alpha
-//
-//		y^T \alpha = \delta
-//		y_i = +1 or -1
-//		0 <= alpha_i <= Cp for y_i = 1
-//		0 <= alpha_i <= Cn for y_i = -1
-//
-// Given:
-//
-//	Q, p, y, Cp, Cn, and an initial feasible point \alpha
-//	l is the size of vectors and matrices
-//	eps is the stopping tolerance
-//
-// solution will be put in \alpha, objective value will be put in obj
-//
-class Solver {
-public:
-	Solver() {};
-	virtual ~Solver() {};
-
-	struct SolutionInfo {
-		double obj;
-		double rho;
-		double upper_bound_p;
-		double upper_bound_n;
-		double r;	// for Solver_NU
-	};
-
-	void Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
-		   double *alpha_, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking);
+template<int KT> void Kernel::k_function_values(const svm_node *x, const svm_node * const *SV,
+						int l, const svm_parameter& param, double *kvalue,
+						const double *SV_square)
+{
+	int i;
+	switch(KT)
+	{
+		case RBF:
+			if(SV_square)
+			{
+				double x_square = dot(x,x);
+				for(i=0;i<l;i++)
+					kvalue[i] = -param.gamma*(x_square+SV_square[i]-2*dot(x,SV[i]));
+			}
+			else
+				for(i=0;i<l;i++)
+					kvalue[i] = -param.gamma*squared_distance(x,SV[i]);
+			exp_values(kvalue,l);
+			break;
+		case SIGMOID:
+			for(i=0;i<l;i++)
+				kvalue[i] = param.gamma*dot(x,SV[i])+param.coef0;
+			tanh_values(kvalue,l);
+			break;
+		default:
+			for(i=0;i<l;i++)
+				kvalue[i] = k_function<KT>(x,SV[i],param);
+	}
+}
+
+double Kernel::k_function(const svm_node *x, const svm_node *y,
+			  const svm_parameter& param)
+{
+	switch(param.kernel_type)
+	{
+		case LINEAR:
+			return k_function<LINEAR>(x,y,param);
+		case POLY:
+			return k_function<POLY>(x,y,param);
+		case RBF:
+			return k_function<RBF>(x,y,param);
+		case SIGMOID:
+			return k_function<SIGMOID>(x,y,param);
+		case PRECOMPUTED:
+			return k_function<PRECOMPUTED>(x,y,param);
+		default:
+			return 0;  // Unreachable
+	}
+}
+
+void Kernel::k_function_values(const svm_node *x, const svm_node * const *SV, int l,
+			       const svm_parameter& param, double *kvalue,
+			       const double *SV_square)
+{
+	switch(param.kernel_type)
+	{
+		case LINEAR:
+			k_function_values<LINEAR>(x,SV,l,param,kvalue,SV_square);
+			break;
+		case POLY:
+			k_function_values<POLY>(x,SV,l,param,kvalue,SV_square);
+			break;
+		case RBF:
+			k_function_values<RBF>(x,SV,l,param,kvalue,SV_square);
+			break;
+		case SIGMOID:
+			k_function_values<SIGMOID>(x,SV,l,param,kvalue,SV_square);
+			break;
+		case PRECOMPUTED:
+			k_function_values<PRECOMPUTED>(x,SV,l,param,kvalue,SV_square);
+			break;
+	}
+}
+
+// Loops of an SMO iteration over the active set are split among the
+// OpenMP threads when it has at least SMO_PARALLEL_MIN elements; the team
+// is kept alive by the OpenMP runtime between iterations. Maxima and minima
+// are merged so that ties go to the larger index, as in a serial scan, and
+// the result does not depend on the number of threads.
+#define SMO_PARALLEL_MIN 16384
+
+static inline void merge_max(double &Gmax, int &Gmax_idx, double G, int idx)
+{
+	if(G > Gmax || (G == Gmax && idx > Gmax_idx))
+	{
+		Gmax = G;
+		Gmax_idx = idx;
+	}
+}
+
+static inline void merge_min(double &obj_min, int &obj_min_idx, double obj, int idx)
+{
+	if(obj < obj_min || (obj == obj_min && idx > obj_min_idx))
+	{
+		obj_min = obj;
+		obj_min_idx = idx;
+	}
+}
+
+// An SMO algorithm in Fan et al., JMLR 6(2005), p. 1889--1918
+// Solves:
+//
+//	min 0.5(\alpha^T Q \alpha) + p^T \alpha
+//
+//		y^T \alpha = \delta
+//		y_i = +1 or -1
+//		0 <= alpha_i <= Cp for y_i = 1
+//		0 <= alpha_i <= Cn for y_i = -1
+//
+// Given:
+//
+//	Q, p, y, Cp, Cn, and an initial feasible point \alpha
+//	l is the size of vectors and matrices
+//	eps is the stopping tolerance
+//
+// solution will be put in \alpha, objective value will be put in obj
+//
+class Solver {
+public:
+	Solver() {};
+	virtual ~Solver() {};
+
+	struct SolutionInfo {
+		double obj;
+		double rho;
+		double upper_bound_p;
+		double upper_bound_n;
+		double r;	// for Solver_NU
+		bool converged;	// false if stopped at max_iter or by the monitor
+	};
+
+	void Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
+		   double *alpha_, double Cp, double Cn, double eps,
+		   SolutionInfo* si, int shrinking, const svm_parameter *param = NULL);
 protected:
 	int active_size;
 	schar *y;
 	double *G;		// gradient of objective function
 	enum { LOWER_BOUND, UPPER_BOUND, FREE };
 	char *alpha_status;	// LOWER_BOUND, UPPER_BOUND, FREE
+	char *in_up;		// 1 if i in I_up(\alpha), i.e. -y_i may increase
+	char *in_low;		// 1 if i in I_low(\alpha)
 	double *alpha;
 	const QMatrix *Q;
 	const double *QD;
@@ -423,6 +1117,17 @@ protected:
 	int l;
 	bool unshrink;	// XXX
 
+	// telemetry: Gmax+Gmax2 of the last select_working_set, and the
+	// numbers of shrinking checks and gradient reconstructions
+	double kkt_violation;
+	int nr_shrink, nr_reconstruct;
+
+	// maximal -y_t*G_t in I_up for y_t = +1 and y_t = -1, found while
+	// updating G; valid until the next select_working_set or shrinking
+	bool Gmax_found;
+	double Gmaxp_found, Gmaxn_found;
+	int Gmaxp_found_idx, Gmaxn_found_idx;
+
 	double get_C(int i)
 	{
 		return (y[i] > 0)? Cp : Cn;
@@ -434,12 +1139,16 @@ protected:
 		else if(alpha[i] <= 0)
 			alpha_status[i] = LOWER_BOUND;
 		else alpha_status[i] = FREE;
+		in_up[i] = alpha_status[i] != (y[i] > 0 ? UPPER_BOUND : LOWER_BOUND);
+		in_low[i] = alpha_status[i] != (y[i] > 0 ? LOWER_BOUND : UPPER_BOUND);
 	}
 	bool is_upper_bound(int i) { return alpha_status[i] == UPPER_BOUND; }
 	bool is_lower_bound(int i) { return alpha_status[i] == LOWER_BOUND; }
 	bool is_free(int i) { return alpha_status[i] == FREE; }
 	void swap_index(int i, int j);
 	void reconstruct_gradient();
+	void report_telemetry(const svm_monitor *monitor, int iter, double obj, bool finished);
+	void find_Gmax(double &Gmaxp, int &Gmaxp_idx, double &Gmaxn, int &Gmaxn_idx);
 	virtual int select_working_set(int &i, int &j);
 	virtual double calculate_rho();
 	virtual void do_shrinking();
@@ -453,6 +1162,8 @@ void Solver::swap_index(int i, int j)
 	swap(y[i],y[j]);
 	swap(G[i],G[j]);
 	swap(alpha_status[i],alpha_status[j]);
+	swap(in_up[i],in_up[j]);
+	swap(in_low[i],in_low[j]);
 	swap(alpha[i],alpha[j]);
 	swap(p[i],p[j]);
 	swap(active_set[i],active_set[j]);
@@ -464,6 +1175,8 @@ void Solver::reconstruct_gradient()
 	// reconstruct inactive elements of G from G_bar and free variables
 
 	if(active_size == l) return;
+	++nr_reconstruct;
+	SVM_PROBE2(reconstruct__gradient,active_size,l);
 
 	int i,j;
 	int nr_free = 0;
@@ -495,16 +1208,32 @@ void Solver::reconstruct_gradient()
 			{
 				const Qfloat *Q_i = Q->get_Q(i,l);
 				double alpha_i = alpha[i];
+SVM_OMP(omp parallel for schedule(static) if(l-active_size >= SMO_PARALLEL_MIN))
 				for(j=active_size;j<l;j++)
 					G[j] += alpha_i * Q_i[j];
 			}
 	}
 }
 
+void Solver::report_telemetry(const svm_monitor *monitor, int iter, double obj, bool finished)
+{
+	svm_telemetry t;
+	t.subproblem = monitor->subproblem.load(std::memory_order_relaxed);
+	t.iter = iter;
+	t.obj = obj;
+	t.kkt_violation = kkt_violation;
+	t.active_size = active_size;
+	t.nr_shrink = nr_shrink;
+	t.nr_reconstruct = nr_reconstruct;
+	t.finished = finished;
+	monitor->telemetry(&t,monitor->telemetry_data);
+}
+
 void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		   double *alpha_, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking)
+		   SolutionInfo* si, int shrinking, const svm_parameter *param)
 {
+	svm_monitor *monitor = param ? param->monitor : NULL;
 	this->l = l;
 	this->Q = &Q;
 	QD=Q.get_QD();
@@ -515,10 +1244,16 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	this->Cn = Cn;
 	this->eps = eps;
 	unshrink = false;
+	Gmax_found = false;
+	kkt_violation = INF;
+	nr_shrink = 0;
+	nr_reconstruct = 0;
 
 	// initialize alpha_status
 	{
 		alpha_status = new char[l];
+		in_up = new char[l];
+		in_low = new char[l];
 		for(int i=0;i<l;i++)
 			update_alpha_status(i);
 	}
@@ -559,7 +1294,22 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 
 	int iter = 0;
 	int max_iter = max(10000000, l>INT_MAX/100 ? INT_MAX : 100*l);
+	if(param && param->max_iter > 0)
+		max_iter = param->max_iter;
 	int counter = min(l,1000)+1;
+	bool stopped = false;
+	double obj = 0;	// objective value reported to the monitor
+	SVM_PROBE1(solve__start,l);
+
+	if(monitor)
+	{
+		for(int k=0;k<l;k++)
+			obj += alpha[k] * (G[k] + p[k]);
+		obj /= 2;
+		monitor->iter.store(0,std::memory_order_relaxed);
+		monitor->obj.store(obj,std::memory_order_relaxed);
+		monitor->active_size.store(l,std::memory_order_relaxed);
+	}
 
 	while(iter < max_iter)
 	{
@@ -568,8 +1318,24 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		if(--counter == 0)
 		{
 			counter = min(l,1000);
-			if(shrinking) do_shrinking();
+			if(shrinking)
+			{
+				do_shrinking();
+				++nr_shrink;
+			}
 			info(".");
+			if(monitor)
+				monitor->active_size.store(active_size,std::memory_order_relaxed);
+		}
+
+		if(monitor)
+		{
+			monitor->iter.store(iter,std::memory_order_relaxed);
+			if(is_training_stopped(monitor))
+			{
+				stopped = true;
+				break;
+			}
 		}
 
 		int i,j;
@@ -579,6 +1345,7 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			reconstruct_gradient();
 			// reset active set size and check
 			active_size = l;
+			Gmax_found = false;
 			info("*");
 			if(select_working_set(i,j)!=0)
 				break;
@@ -586,6 +1353,9 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 				counter = 1;	// do shrinking next iteration
 		}
 
+		if(monitor && monitor->telemetry && monitor->telemetry_interval > 0 && iter % monitor->telemetry_interval == 0)
+			report_telemetry(monitor,iter,obj,false);
+
 		++iter;
 
 		// update alpha[i] and alpha[j], handle bounds carefully
@@ -686,31 +1456,78 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			}
 		}
 
-		// update G
+		// update alpha_status
+
+		bool ui = is_upper_bound(i);
+		bool uj = is_upper_bound(j);
+		update_alpha_status(i);
+		update_alpha_status(j);
+
+		// update G, and find the maximal violating indices for the next
+		// select_working_set in the same pass
 
 		double delta_alpha_i = alpha[i] - old_alpha_i;
 		double delta_alpha_j = alpha[j] - old_alpha_j;
 
-		for(int k=0;k<active_size;k++)
+		if(monitor)
+		{
+			// change of the objective value by the update of alpha[i] and alpha[j]
+			obj += delta_alpha_i*(G[i] + 0.5*QD[i]*delta_alpha_i + Q_i[j]*delta_alpha_j)
+				+ delta_alpha_j*(G[j] + 0.5*QD[j]*delta_alpha_j);
+			monitor->obj.store(obj,std::memory_order_relaxed);
+		}
+
+		Gmax_found = true;
+		Gmaxp_found = -INF;
+		Gmaxn_found = -INF;
+		Gmaxp_found_idx = -1;
+		Gmaxn_found_idx = -1;
+SVM_OMP(omp parallel if(active_size >= SMO_PARALLEL_MIN))
 		{
-			G[k] += Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j;
+			double Gmaxp = -INF, Gmaxn = -INF;
+			int Gmaxp_idx = -1, Gmaxn_idx = -1;
+SVM_OMP(omp for schedule(static) nowait)
+			for(int k=0;k<active_size;k++)
+			{
+				double G_k = G[k] + (Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j);
+				G[k] = G_k;
+				if(in_up[k])
+				{
+					if(y[k] > 0)
+					{
+						if(-G_k >= Gmaxp)
+						{
+							Gmaxp = -G_k;
+							Gmaxp_idx = k;
+						}
+					}
+					else if(G_k >= Gmaxn)
+					{
+						Gmaxn = G_k;
+						Gmaxn_idx = k;
+					}
+				}
+			}
+SVM_OMP(omp critical(svm_smo_merge))
+			{
+				merge_max(Gmaxp_found,Gmaxp_found_idx,Gmaxp,Gmaxp_idx);
+				merge_max(Gmaxn_found,Gmaxn_found_idx,Gmaxn,Gmaxn_idx);
+			}
 		}
 
-		// update alpha_status and G_bar
+		// update G_bar
 
 		{
-			bool ui = is_upper_bound(i);
-			bool uj = is_upper_bound(j);
-			update_alpha_status(i);
-			update_alpha_status(j);
 			int k;
 			if(ui != is_upper_bound(i))
 			{
 				Q_i = Q.get_Q(i,l);
 				if(ui)
+SVM_OMP(omp parallel for schedule(static) if(l >= SMO_PARALLEL_MIN))
 					for(k=0;k<l;k++)
 						G_bar[k] -= C_i * Q_i[k];
 				else
+SVM_OMP(omp parallel for schedule(static) if(l >= SMO_PARALLEL_MIN))
 					for(k=0;k<l;k++)
 						G_bar[k] += C_i * Q_i[k];
 			}
@@ -719,16 +1536,19 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			{
 				Q_j = Q.get_Q(j,l);
 				if(uj)
+SVM_OMP(omp parallel for schedule(static) if(l >= SMO_PARALLEL_MIN))
 					for(k=0;k<l;k++)
 						G_bar[k] -= C_j * Q_j[k];
 				else
+SVM_OMP(omp parallel for schedule(static) if(l >= SMO_PARALLEL_MIN))
 					for(k=0;k<l;k++)
 						G_bar[k] += C_j * Q_j[k];
 			}
 		}
 	}
 
-	if(iter >= max_iter)
+	si->converged = iter < max_iter && !stopped;
+	if(!si->converged)
 	{
 		if(active_size < l)
 		{
@@ -737,7 +1557,10 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			active_size = l;
 			info("*");
 		}
-		fprintf(stderr,"\nWARNING: reaching max number of iterations\n");
+		if(stopped)
+			info("\nWARNING: training is cancelled or out of time\n");
+		else
+			fprintf(stderr,"\nWARNING: reaching max number of iterations\n");
 	}
 
 	// calculate rho
@@ -771,17 +1594,80 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	si->upper_bound_p = Cp;
 	si->upper_bound_n = Cn;
 
+	if(monitor)
+	{
+		monitor->iter.store(iter,std::memory_order_relaxed);
+		monitor->obj.store(si->obj,std::memory_order_relaxed);
+		monitor->active_size.store(active_size,std::memory_order_relaxed);
+		if(monitor->telemetry)
+			report_telemetry(monitor,iter,si->obj,true);
+	}
+	SVM_PROBE3(solve__done,l,iter,active_size);
+
 	info("\noptimization finished, #iter = %d\n",iter);
 
 	delete[] p;
 	delete[] y;
 	delete[] alpha;
 	delete[] alpha_status;
+	delete[] in_up;
+	delete[] in_low;
 	delete[] active_set;
 	delete[] G;
 	delete[] G_bar;
 }
 
+// maximal -y_t*grad(f)_t in I_up(\alpha) for y_t = +1 and y_t = -1, taken from
+// the last update of G if possible
+void Solver::find_Gmax(double &Gmaxp, int &Gmaxp_idx, double &Gmaxn, int &Gmaxn_idx)
+{
+	if(Gmax_found)
+	{
+		Gmax_found = false;
+		Gmaxp = Gmaxp_found;
+		Gmaxn = Gmaxn_found;
+		Gmaxp_idx = Gmaxp_found_idx;
+		Gmaxn_idx = Gmaxn_found_idx;
+		return;
+	}
+
+	Gmaxp = -INF;
+	Gmaxn = -INF;
+	Gmaxp_idx = -1;
+	Gmaxn_idx = -1;
+SVM_OMP(omp parallel if(active_size >= SMO_PARALLEL_MIN))
+	{
+		double Gmaxp_t = -INF, Gmaxn_t = -INF;
+		int Gmaxp_idx_t = -1, Gmaxn_idx_t = -1;
+SVM_OMP(omp for schedule(static) nowait)
+		for(int t=0;t<active_size;t++)
+			if(in_up[t])
+			{
+				if(y[t]==+1)
+				{
+					if(-G[t] >= Gmaxp_t)
+					{
+						Gmaxp_t = -G[t];
+						Gmaxp_idx_t = t;
+					}
+				}
+				else
+				{
+					if(G[t] >= Gmaxn_t)
+					{
+						Gmaxn_t = G[t];
+						Gmaxn_idx_t = t;
+					}
+				}
+			}
+SVM_OMP(omp critical(svm_smo_merge))
+		{
+			merge_max(Gmaxp,Gmaxp_idx,Gmaxp_t,Gmaxp_idx_t);
+			merge_max(Gmaxn,Gmaxn_idx,Gmaxn_t,Gmaxn_idx_t);
+		}
+	}
+}
+
 // return 1 if already optimal, return 0 otherwise
 int Solver::select_working_set(int &out_i, int &out_j)
 {
@@ -797,83 +1683,69 @@ int Solver::select_working_set(int &out_i, int &out_j)
 	int Gmin_idx = -1;
 	double obj_diff_min = INF;
 
-	for(int t=0;t<active_size;t++)
-		if(y[t]==+1)
+	{
+		double Gmaxp, Gmaxn;
+		int Gmaxp_idx, Gmaxn_idx;
+		find_Gmax(Gmaxp,Gmaxp_idx,Gmaxn,Gmaxn_idx);
+		// the last index wins ties, as in a single scan with >=
+		if(Gmaxp > Gmaxn || (Gmaxp == Gmaxn && Gmaxp_idx > Gmaxn_idx))
 		{
-			if(!is_upper_bound(t))
-				if(-G[t] >= Gmax)
-				{
-					Gmax = -G[t];
-					Gmax_idx = t;
-				}
+			Gmax = Gmaxp;
+			Gmax_idx = Gmaxp_idx;
 		}
 		else
 		{
-			if(!is_lower_bound(t))
-				if(G[t] >= Gmax)
-				{
-					Gmax = G[t];
-					Gmax_idx = t;
-				}
+			Gmax = Gmaxn;
+			Gmax_idx = Gmaxn_idx;
 		}
+	}
 
 	int i = Gmax_idx;
 	const Qfloat *Q_i = NULL;
 	if(i != -1) // NULL Q_i not accessed: Gmax=-INF if i=-1
 		Q_i = Q->get_Q(i,active_size);
 
-	for(int j=0;j<active_size;j++)
+	// y_j*G_j, quad_coef and obj_diff are written for both signs of y_j,
+	// with the same rounding as separate branches
+SVM_OMP(omp parallel if(active_size >= SMO_PARALLEL_MIN))
 	{
-		if(y[j]==+1)
+		double Gmax2_t = -INF;
+		int Gmin_idx_t = -1;
+		double obj_diff_min_t = INF;
+SVM_OMP(omp for schedule(static) nowait)
+		for(int j=0;j<active_size;j++)
 		{
-			if (!is_lower_bound(j))
+			if (in_low[j])
 			{
-				double grad_diff=Gmax+G[j];
-				if (G[j] >= Gmax2)
-					Gmax2 = G[j];
+				double yG_j = y[j]*G[j];
+				double grad_diff=Gmax+yG_j;
+				if (yG_j >= Gmax2_t)
+					Gmax2_t = yG_j;
 				if (grad_diff > 0)
 				{
 					double obj_diff;
-					double quad_coef = QD[i]+QD[j]-2.0*y[i]*Q_i[j];
+					double quad_coef = QD[i]+QD[j]-2.0*y[i]*y[j]*Q_i[j];
 					if (quad_coef > 0)
 						obj_diff = -(grad_diff*grad_diff)/quad_coef;
 					else
 						obj_diff = -(grad_diff*grad_diff)/TAU;
 
-					if (obj_diff <= obj_diff_min)
+					if (obj_diff <= obj_diff_min_t)
 					{
-						Gmin_idx=j;
-						obj_diff_min = obj_diff;
+						Gmin_idx_t=j;
+						obj_diff_min_t = obj_diff;
 					}
 				}
 			}
 		}
-		else
+SVM_OMP(omp critical(svm_smo_merge))
 		{
-			if (!is_upper_bound(j))
-			{
-				double grad_diff= Gmax-G[j];
-				if (-G[j] >= Gmax2)
-					Gmax2 = -G[j];
-				if (grad_diff > 0)
-				{
-					double obj_diff;
-					double quad_coef = QD[i]+QD[j]+2.0*y[i]*Q_i[j];
-					if (quad_coef > 0)
-						obj_diff = -(grad_diff*grad_diff)/quad_coef;
-					else
-						obj_diff = -(grad_diff*grad_diff)/TAU;
-
-					if (obj_diff <= obj_diff_min)
-					{
-						Gmin_idx=j;
-						obj_diff_min = obj_diff;
-					}
-				}
-			}
+			Gmax2 = max(Gmax2,Gmax2_t);
+			merge_min(obj_diff_min,Gmin_idx,obj_diff_min_t,Gmin_idx_t);
 		}
 	}
 
+	kkt_violation = Gmax+Gmax2;
 	if(Gmax+Gmax2 < eps || Gmin_idx == -1)
 		return 1;
 
@@ -908,6 +1780,8 @@ void Solver::do_shrinking()
 	double Gmax1 = -INF;		// max { -y_i * grad(f)_i | i in I_up(\alpha) }
 	double Gmax2 = -INF;		// max { y_i * grad(f)_i | i in I_low(\alpha) }
 
+	Gmax_found = false;
+
 	// find maximal violating pair first
 	for(i=0;i<active_size;i++)
 	{
@@ -961,6 +1835,7 @@ void Solver::do_shrinking()
 				active_size--;
 			}
 		}
+	SVM_PROBE2(do__shrinking,active_size,l);
 }
 
 double Solver::calculate_rho()
@@ -1012,10 +1887,10 @@ public:
 	Solver_NU() {}
 	void Solve(int l, const QMatrix& Q, const double *p, const schar *y,
 		   double *alpha, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking)
+		   SolutionInfo* si, int shrinking, const svm_parameter *param = NULL)
 	{
 		this->si = si;
-		Solver::Solve(l,Q,p,y,alpha,Cp,Cn,eps,si,shrinking);
+		Solver::Solve(l,Q,p,y,alpha,Cp,Cn,eps,si,shrinking,param);
 	}
 private:
 	SolutionInfo *si;
@@ -1034,36 +1909,15 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 	//    (if quadratic coefficeint <= 0, replace it with tau)
 	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
 
-	double Gmaxp = -INF;
+	double Gmaxp, Gmaxn;
+	int Gmaxp_idx, Gmaxn_idx;
 	double Gmaxp2 = -INF;
-	int Gmaxp_idx = -1;
-
-	double Gmaxn = -INF;
 	double Gmaxn2 = -INF;
-	int Gmaxn_idx = -1;
 
 	int Gmin_idx = -1;
 	double obj_diff_min = INF;
 
-	for(int t=0;t<active_size;t++)
-		if(y[t]==+1)
-		{
-			if(!is_upper_bound(t))
-				if(-G[t] >= Gmaxp)
-				{
-					Gmaxp = -G[t];
-					Gmaxp_idx = t;
-				}
-		}
-		else
-		{
-			if(!is_lower_bound(t))
-				if(G[t] >= Gmaxn)
-				{
-					Gmaxn = G[t];
-					Gmaxn_idx = t;
-				}
-		}
+	find_Gmax(Gmaxp,Gmaxp_idx,Gmaxn,Gmaxn_idx);
 
 	int ip = Gmaxp_idx;
 	int in = Gmaxn_idx;
@@ -1074,15 +1928,21 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 	if(in != -1)
 		Q_in = Q->get_Q(in,active_size);
 
-	for(int j=0;j<active_size;j++)
+SVM_OMP(omp parallel if(active_size >= SMO_PARALLEL_MIN))
 	{
-		if(y[j]==+1)
+		double Gmaxp2_t = -INF, Gmaxn2_t = -INF;
+		int Gmin_idx_t = -1;
+		double obj_diff_min_t = INF;
+SVM_OMP(omp for schedule(static) nowait)
+		for(int j=0;j<active_size;j++)
 		{
-			if (!is_lower_bound(j))
+			if (!in_low[j])
+				continue;
+			if(y[j]==+1)
 			{
 				double grad_diff=Gmaxp+G[j];
-				if (G[j] >= Gmaxp2)
-					Gmaxp2 = G[j];
+				if (G[j] >= Gmaxp2_t)
+					Gmaxp2_t = G[j];
 				if (grad_diff > 0)
 				{
 					double obj_diff;
@@ -1092,21 +1952,18 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 					else
 						obj_diff = -(grad_diff*grad_diff)/TAU;
 
-					if (obj_diff <= obj_diff_min)
+					if (obj_diff <= obj_diff_min_t)
 					{
-						Gmin_idx=j;
-						obj_diff_min = obj_diff;
+						Gmin_idx_t=j;
+						obj_diff_min_t = obj_diff;
 					}
 				}
 			}
-		}
-		else
-		{
-			if (!is_upper_bound(j))
+			else
 			{
 				double grad_diff=Gmaxn-G[j];
-				if (-G[j] >= Gmaxn2)
-					Gmaxn2 = -G[j];
+				if (-G[j] >= Gmaxn2_t)
+					Gmaxn2_t = -G[j];
 				if (grad_diff > 0)
 				{
 					double obj_diff;
@@ -1116,16 +1973,23 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 					else
 						obj_diff = -(grad_diff*grad_diff)/TAU;
 
-					if (obj_diff <= obj_diff_min)
+					if (obj_diff <= obj_diff_min_t)
 					{
-						Gmin_idx=j;
-						obj_diff_min = obj_diff;
+						Gmin_idx_t=j;
+						obj_diff_min_t = obj_diff;
 					}
 				}
 			}
 		}
+SVM_OMP(omp critical(svm_smo_merge))
+		{
+			Gmaxp2 = max(Gmaxp2,Gmaxp2_t);
+			Gmaxn2 = max(Gmaxn2,Gmaxn2_t);
+			merge_min(obj_diff_min,Gmin_idx,obj_diff_min_t,Gmin_idx_t);
+		}
 	}
 
+	kkt_violation = max(Gmaxp+Gmaxp2,Gmaxn+Gmaxn2);
 	if(max(Gmaxp+Gmaxp2,Gmaxn+Gmaxn2) < eps || Gmin_idx == -1)
 		return 1;
 
@@ -1165,6 +2029,8 @@ void Solver_NU::do_shrinking()
 	double Gmax3 = -INF;	// max { -y_i * grad(f)_i | y_i = -1, i in I_up(\alpha) }
 	double Gmax4 = -INF;	// max { y_i * grad(f)_i | y_i = -1, i in I_low(\alpha) }
 
+	Gmax_found = false;
+
 	// find maximal violating pair first
 	int i;
 	for(i=0;i<active_size;i++)
@@ -1208,6 +2074,7 @@ void Solver_NU::do_shrinking()
 				active_size--;
 			}
 		}
+	SVM_PROBE2(do__shrinking,active_size,l);
 }
 
 double Solver_NU::calculate_rho()
@@ -1270,21 +2137,22 @@ public:
 	:Kernel(prob.l, prob.x, param)
 	{
 		clone(y,y_,prob.l);
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		long int size = (long int)(param.cache_size*(1<<20));
+		cache = fill_full_Q(prob.l,size,y) ? NULL : new Cache(prob.l,size);
 		QD = new double[prob.l];
 		for(int i=0;i<prob.l;i++)
 			QD[i] = (this->*kernel_function)(i,i);
+		nr_eval += prob.l;
 	}
 
 	Qfloat *get_Q(int i, int len) const
 	{
+		if(Q_full) return Q_full[i];
+
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
-		}
+			fill_Q_column(i,data,start,len,y);
 		return data;
 	}
 
@@ -1295,7 +2163,7 @@ public:
 
 	void swap_index(int i, int j) const
 	{
-		cache->swap_index(i,j);
+		if(Q_full) swap_full_Q(i,j); else cache->swap_index(i,j);
 		Kernel::swap_index(i,j);
 		swap(y[i],y[j]);
 		swap(QD[i],QD[j]);
@@ -1303,6 +2171,7 @@ public:
 
 	~SVC_Q()
 	{
+		add_cache_stats(cache);
 		delete[] y;
 		delete cache;
 		delete[] QD;
@@ -1319,21 +2188,22 @@ public:
 	ONE_CLASS_Q(const svm_problem& prob, const svm_parameter& param)
 	:Kernel(prob.l, prob.x, param)
 	{
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		long int size = (long int)(param.cache_size*(1<<20));
+		cache = fill_full_Q(prob.l,size,NULL) ? NULL : new Cache(prob.l,size);
 		QD = new double[prob.l];
 		for(int i=0;i<prob.l;i++)
 			QD[i] = (this->*kernel_function)(i,i);
+		nr_eval += prob.l;
 	}
 
 	Qfloat *get_Q(int i, int len) const
 	{
+		if(Q_full) return Q_full[i];
+
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(i,j);
-		}
+			fill_Q_column(i,data,start,len,NULL);
 		return data;
 	}
 
@@ -1344,13 +2214,14 @@ public:
 
 	void swap_index(int i, int j) const
 	{
-		cache->swap_index(i,j);
+		if(Q_full) swap_full_Q(i,j); else cache->swap_index(i,j);
 		Kernel::swap_index(i,j);
 		swap(QD[i],QD[j]);
 	}
 
 	~ONE_CLASS_Q()
 	{
+		add_cache_stats(cache);
 		delete cache;
 		delete[] QD;
 	}
@@ -1366,7 +2237,8 @@ public:
 	:Kernel(prob.l, prob.x, param)
 	{
 		l = prob.l;
-		cache = new Cache(l,(long int)(param.cache_size*(1<<20)));
+		long int size = (long int)(param.cache_size*(1<<20));
+		cache = fill_full_Q(l,size,NULL) ? NULL : new Cache(l,size);
 		QD = new double[2*l];
 		sign = new schar[2*l];
 		index = new int[2*l];
@@ -1379,6 +2251,7 @@ public:
 			QD[k] = (this->*kernel_function)(k,k);
 			QD[k+l] = QD[k];
 		}
+		nr_eval += l;
 		buffer[0] = new Qfloat[2*l];
 		buffer[1] = new Qfloat[2*l];
 		next_buffer = 0;
@@ -1395,11 +2268,10 @@ public:
 	{
 		Qfloat *data;
 		int j, real_i = index[i];
-		if(cache->get_data(real_i,&data,l) < l)
-		{
-			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
-		}
+		if(Q_full)
+			data = Q_full[real_i];
+		else if(cache->get_data(real_i,&data,l) < l)
+			fill_Q_column(real_i,data,0,l,NULL);
 
 		// reorder and copy
 		Qfloat *buf = buffer[next_buffer];
@@ -1417,6 +2289,7 @@ public:
 
 	~SVR_Q()
 	{
+		add_cache_stats(cache);
 		delete cache;
 		delete[] sign;
 		delete[] index;
@@ -1456,7 +2329,7 @@ static void solve_c_svc(
 
 	Solver s;
 	s.Solve(l, SVC_Q(*prob,*param,y), minus_ones, y,
-		alpha, Cp, Cn, param->eps, si, param->shrinking);
+		alpha, Cp, Cn, param->eps, si, param->shrinking, param);
 
 	double sum_alpha=0;
 	for(i=0;i<l;i++)
@@ -1510,7 +2383,7 @@ static void solve_nu_svc(
 
 	Solver_NU s;
 	s.Solve(l, SVC_Q(*prob,*param,y), zeros, y,
-		alpha, 1.0, 1.0, param->eps, si,  param->shrinking);
+		alpha, 1.0, 1.0, param->eps, si,  param->shrinking, param);
 	double r = si->r;
 
 	info("C = %f\n",1/r);
@@ -1553,7 +2426,7 @@ static void solve_one_class(
 
 	Solver s;
 	s.Solve(l, ONE_CLASS_Q(*prob,*param), zeros, ones,
-		alpha, 1.0, 1.0, param->eps, si, param->shrinking);
+		alpha, 1.0, 1.0, param->eps, si, param->shrinking, param);
 
 	delete[] zeros;
 	delete[] ones;
@@ -1582,7 +2455,7 @@ static void solve_epsilon_svr(
 
 	Solver s;
 	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
-		alpha2, param->C, param->C, param->eps, si, param->shrinking);
+		alpha2, param->C, param->C, param->eps, si, param->shrinking, param);
 
 	double sum_alpha = 0;
 	for(i=0;i<l;i++)
@@ -1623,7 +2496,7 @@ static void solve_nu_svr(
 
 	Solver_NU s;
 	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
-		alpha2, C, C, param->eps, si, param->shrinking);
+		alpha2, C, C, param->eps, si, param->shrinking, param);
 
 	info("epsilon = %f\n",-si->r);
 
@@ -1642,6 +2515,7 @@ struct decision_function
 {
 	double *alpha;
 	double rho;
+	bool converged;
 };
 
 static decision_function svm_train_one(
@@ -1698,6 +2572,7 @@ static decision_function svm_train_one(
 	decision_function f;
 	f.alpha = alpha;
 	f.rho = si.rho;
+	f.converged = si.converged;
 	return f;
 }
 
@@ -1903,7 +2778,7 @@ static void svm_binary_svc_probability(
 	for(i=0;i<prob->l;i++) perm[i]=i;
 	for(i=0;i<prob->l;i++)
 	{
-		int j = i+rand()%(prob->l-i);
+		int j = i+svm_rand(param)%(prob->l-i);
 		swap(perm[i],perm[j]);
 	}
 	for(i=0;i<nr_fold;i++)
@@ -1965,6 +2840,8 @@ static void svm_binary_svc_probability(
 				// ensure +1 -1 order; reason not using CV subroutine
 				dec_values[perm[j]] *= submodel->label[0];
 			}
+			if(param->monitor)
+				param->monitor->kernel_stats.predict_kernel_evaluations += (long long)(end-begin)*submodel->l;
 			svm_free_and_destroy_model(&submodel);
 			svm_destroy_param(&subparam);
 		}
@@ -1988,21 +2865,42 @@ static double svm_svr_probability(
 	svm_parameter newparam = *param;
 	newparam.probability = 0;
 	svm_cross_validation(prob,&newparam,nr_fold,ymv);
+	// samples of folds not trained because training was stopped are NaN
+	int n=0;
 	for(i=0;i<prob->l;i++)
+		if(!isnan(ymv[i]))
+		{
+			ymv[i]=prob->y[i]-ymv[i];
+			mae += fabs(ymv[i]);
+			++n;
+		}
+	if(n == 0)
 	{
-		ymv[i]=prob->y[i]-ymv[i];
-		mae += fabs(ymv[i]);
+		// no fold was trained: sigma of predicting the mean target value
+		double mean = 0;
+		for(i=0;i<prob->l;i++)
+			mean += prob->y[i];
+		mean /= prob->l;
+		for(i=0;i<prob->l;i++)
+			mae += fabs(prob->y[i]-mean);
+		free(ymv);
+		return mae/prob->l;
 	}
-	mae /= prob->l;
+	mae /= n;
 	double std=sqrt(2*mae*mae);
 	int count=0;
 	mae=0;
 	for(i=0;i<prob->l;i++)
-		if (fabs(ymv[i]) > 5*std)
+		if (isnan(ymv[i]))
+			continue;
+		else if (fabs(ymv[i]) > 5*std)
 			count=count+1;
 		else
 			mae+=fabs(ymv[i]);
-	mae /= (prob->l-count);
+	if(n > count)
+		mae /= (n-count);
+	else
+		mae = std/sqrt(2.0);	// all errors are outliers: keep the mean of all of them
 	info("Prob. model for test data: target value = predicted value + z,\nz: Laplace distribution e^(-|z|/sigma)/(2sigma),sigma= %g\n",mae);
 	free(ymv);
 	return mae;
@@ -2089,11 +2987,82 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 //
 // Interface functions
 //
-svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+// Take the timing of the monitor for the outermost svm_train or
+// svm_cross_validation, so that the nested calls for probability estimates
+// and folds are not timed. It is given back by end_timing.
+static svm_timing *begin_timing(const svm_parameter *param)
+{
+	if(param->monitor == NULL || param->monitor->timing == NULL)
+		return NULL;
+	svm_timing *timing = param->monitor->timing;
+	param->monitor->timing = NULL;
+	memset(timing,0,sizeof(svm_timing));
+	return timing;
+}
+
+static void end_timing(const svm_parameter *param, svm_timing *timing)
+{
+	if(timing)
+		param->monitor->timing = timing;
+}
+
+// Take the telemetry of the monitor during the cross validation for
+// probability estimates, whose solvers train on folds and would report
+// samples under the subproblem of the decision function. It is given back
+// by attach_telemetry.
+typedef void (*svm_telemetry_function)(const svm_telemetry *, void *);
+
+static svm_telemetry_function detach_telemetry(const svm_parameter *param)
+{
+	if(param->monitor == NULL)
+		return NULL;
+	svm_telemetry_function telemetry = param->monitor->telemetry;
+	param->monitor->telemetry = NULL;
+	return telemetry;
+}
+
+static void attach_telemetry(const svm_parameter *param, svm_telemetry_function telemetry)
+{
+	if(param->monitor)
+		param->monitor->telemetry = telemetry;
+}
+
+void svm_free_timing(svm_timing *timing)
+{
+	free(timing->pair_probability);
+	free(timing->pair_solve);
+	timing->pair_probability = NULL;
+	timing->pair_solve = NULL;
+	timing->nr_pair = 0;
+}
+
+void svm_init_monitor(svm_monitor *monitor)
 {
+	monitor->cancel.store(0,std::memory_order_relaxed);
+	monitor->iter.store(0,std::memory_order_relaxed);
+	monitor->obj.store(0,std::memory_order_relaxed);
+	monitor->active_size.store(0,std::memory_order_relaxed);
+	monitor->subproblem.store(0,std::memory_order_relaxed);
+	monitor->nr_subproblem.store(0,std::memory_order_relaxed);
+	monitor->has_rng = 0;
+	monitor->rng = 0;
+	monitor->deadline = 0;
+	monitor->telemetry_interval = 0;
+	monitor->telemetry = NULL;
+	monitor->telemetry_data = NULL;
+	memset(&monitor->kernel_stats,0,sizeof(monitor->kernel_stats));
+	monitor->timing = NULL;
+}
+
+static svm_model *svm_train_model(const svm_problem *prob, const svm_parameter *param)
+{
+	svm_timing *timing = begin_timing(param);
+	double t = timing ? wall_time() : 0;
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
 	model->free_sv = 0;	// XXX
+	model->compiled = NULL;
+	model->converged = 1;
 
 	if(param->svm_type == ONE_CLASS ||
 	   param->svm_type == EPSILON_SVR ||
@@ -2111,12 +3080,25 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		    param->svm_type == NU_SVR))
 		{
 			model->probA = Malloc(double,1);
+			svm_telemetry_function telemetry = detach_telemetry(param);
 			model->probA[0] = svm_svr_probability(prob,param);
+			attach_telemetry(param,telemetry);
+			if(timing)
+			{
+				timing->probability = wall_time()-t;
+				t = wall_time();
+			}
 		}
 
 		decision_function f = svm_train_one(prob,param,0,0);
+		if(timing)
+		{
+			timing->solve = wall_time()-t;
+			t = wall_time();
+		}
 		model->rho = Malloc(double,1);
 		model->rho[0] = f.rho;
+		model->converged = f.converged;
 
 		int nSV = 0;
 		int i;
@@ -2157,6 +3139,13 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		int i;
 		for(i=0;i<l;i++)
 			x[i] = prob->x[perm[i]];
+		if(timing)
+		{
+			timing->group_classes = wall_time()-t;
+			timing->nr_pair = nr_class*(nr_class-1)/2;
+			timing->pair_probability = Malloc(double,timing->nr_pair);
+			timing->pair_solve = Malloc(double,timing->nr_pair);
+		}
 
 		// calculate weighted C
 
@@ -2211,10 +3200,60 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 					sub_prob.y[ci+k] = -1;
 				}
 
-				if(param->probability)
-					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
+				// the binary problems trained for probability estimates
+				// do not report themselves as subproblems
+				if(param->monitor && nr_class > 2)
+				{
+					param->monitor->subproblem.store(p,std::memory_order_relaxed);
+					param->monitor->nr_subproblem.store(nr_class*(nr_class-1)/2,std::memory_order_relaxed);
+				}
+
+				SVM_PROBE3(subproblem__start,p,nr_class*(nr_class-1)/2,sub_prob.l);
+				if(timing)
+				{
+					timing->pair_probability[p] = 0;
+					timing->pair_solve[p] = 0;
+				}
+				if(is_training_stopped(param->monitor))
+				{
+					// leave the remaining subproblems at the feasible alpha = 0
+					f[p].alpha = Malloc(double,sub_prob.l);
+					for(k=0;k<sub_prob.l;k++)
+						f[p].alpha[k] = 0;
+					f[p].rho = 0;
+					f[p].converged = false;
+					if(param->probability)
+					{
+						probA[p] = 0;
+						probB[p] = 0;
+					}
+				}
+				else
+				{
+					t = timing ? wall_time() : 0;
+					if(param->probability)
+					{
+						svm_telemetry_function telemetry = detach_telemetry(param);
+						svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
+						attach_telemetry(param,telemetry);
+					}
+					if(timing)
+					{
+						timing->pair_probability[p] = wall_time()-t;
+						timing->probability += timing->pair_probability[p];
+						t = wall_time();
+					}
 
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
+					f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
+					if(timing)
+					{
+						timing->pair_solve[p] = wall_time()-t;
+						timing->solve += timing->pair_solve[p];
+					}
+				}
+				SVM_PROBE2(subproblem__done,p,(int)f[p].converged);
+				if(!f[p].converged)
+					model->converged = 0;
 				for(k=0;k<ci;k++)
 					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
 						nonzero[si+k] = true;
@@ -2228,6 +3267,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 
 		// build output
 
+		t = timing ? wall_time() : 0;
 		model->nr_class = nr_class;
 
 		model->label = Malloc(int,nr_class);
@@ -2332,20 +3372,60 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		free(nz_count);
 		free(nz_start);
 	}
+	if(timing)
+		timing->assemble = wall_time()-t;
+	end_timing(param,timing);
 	return model;
 }
 
-// Stratified cross validation
-void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+// Start the time budget of max_time at the outermost svm_train or
+// svm_cross_validation. Nested calls (for probability estimates and cross
+// validation folds) share the deadline through the monitor, which is created
+// here if the caller did not give one.
+static bool start_time_budget(const svm_parameter *param, svm_parameter *budget_param, svm_monitor *local_monitor)
 {
-	int i;
-	int *fold_start;
-	int l = prob->l;
-	int *perm = Malloc(int,l);
-	int nr_class;
-	if (nr_fold > l)
+	if(param->max_time <= 0 || (param->monitor != NULL && param->monitor->deadline > 0))
+		return false;
+	*budget_param = *param;
+	if(param->monitor == NULL)
 	{
-		nr_fold = l;
+		svm_init_monitor(local_monitor);
+		budget_param->monitor = local_monitor;
+	}
+	budget_param->monitor->deadline = wall_time() + param->max_time;
+	return true;
+}
+
+svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	svm_parameter budget_param;
+	svm_monitor local_monitor;
+	svm_model *model;
+	if(!start_time_budget(param,&budget_param,&local_monitor))
+		model = svm_train_model(prob,param);
+	else
+	{
+		model = svm_train_model(prob,&budget_param);
+		budget_param.monitor->deadline = 0;
+	}
+	// the monitor belongs to this training only
+	model->param.monitor = NULL;
+	return model;
+}
+
+// Stratified cross validation
+static void svm_cross_validation_folds(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	svm_timing *timing = begin_timing(param);
+	double t;
+	int i;
+	int *fold_start;
+	int l = prob->l;
+	int *perm = Malloc(int,l);
+	int nr_class;
+	if (nr_fold > l)
+	{
+		nr_fold = l;
 		fprintf(stderr,"WARNING: # folds > # data. Will use # folds = # data instead (i.e., leave-one-out cross validation)\n");
 	}
 	fold_start = Malloc(int,nr_fold+1);
@@ -2357,7 +3437,10 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		int *start = NULL;
 		int *label = NULL;
 		int *count = NULL;
+		t = timing ? wall_time() : 0;
 		svm_group_classes(prob,&nr_class,&label,&start,&count,perm);
+		if(timing)
+			timing->group_classes = wall_time()-t;
 
 		// random shuffle and then data grouped by fold using the array perm
 		int *fold_count = Malloc(int,nr_fold);
@@ -2368,7 +3451,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for (c=0; c<nr_class; c++)
 			for(i=0;i<count[c];i++)
 			{
-				int j = i+rand()%(count[c]-i);
+				int j = i+svm_rand(param)%(count[c]-i);
 				swap(index[start[c]+j],index[start[c]+i]);
 			}
 		for(i=0;i<nr_fold;i++)
@@ -2405,7 +3488,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for(i=0;i<l;i++) perm[i]=i;
 		for(i=0;i<l;i++)
 		{
-			int j = i+rand()%(l-i);
+			int j = i+svm_rand(param)%(l-i);
 			swap(perm[i],perm[j]);
 		}
 		for(i=0;i<=nr_fold;i++)
@@ -2419,6 +3502,14 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		int j,k;
 		struct svm_problem subprob;
 
+		if(is_training_stopped(param->monitor))
+		{
+			// samples of the folds not trained are not predicted
+			for(j=begin;j<end;j++)
+				target[perm[j]] = NAN;
+			continue;
+		}
+
 		subprob.l = l-(end-begin);
 		subprob.x = Malloc(struct svm_node*,subprob.l);
 		subprob.y = Malloc(double,subprob.l);
@@ -2436,7 +3527,13 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 			subprob.y[k] = prob->y[perm[j]];
 			++k;
 		}
+		t = timing ? wall_time() : 0;
 		struct svm_model *submodel = svm_train(&subprob,param);
+		if(timing)
+		{
+			timing->train += wall_time()-t;
+			t = wall_time();
+		}
 		if(param->probability &&
 		   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
 		{
@@ -2448,12 +3545,31 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		else
 			for(j=begin;j<end;j++)
 				target[perm[j]] = svm_predict(submodel,prob->x[perm[j]]);
+		if(param->monitor)
+			param->monitor->kernel_stats.predict_kernel_evaluations += (long long)(end-begin)*submodel->l;
+		if(timing)
+			timing->predict += wall_time()-t;
 		svm_free_and_destroy_model(&submodel);
 		free(subprob.x);
 		free(subprob.y);
 	}
 	free(fold_start);
 	free(perm);
+	end_timing(param,timing);
+}
+
+void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	svm_parameter budget_param;
+	svm_monitor local_monitor;
+	if(!start_time_budget(param,&budget_param,&local_monitor))
+	{
+		svm_cross_validation_folds(prob,param,nr_fold,target);
+		return;
+	}
+
+	svm_cross_validation_folds(prob,&budget_param,nr_fold,target);
+	budget_param.monitor->deadline = 0;
 }
 
 
@@ -2493,55 +3609,1075 @@ double svm_get_svr_probability(const svm_model *model)
 		return model->probA[0];
 	else
 	{
-		fprintf(stderr,"Model doesn't contain information for SVR probability inference\n");
-		return 0;
+		fprintf(stderr,"Model doesn't contain information for SVR probability inference\n");
+		return 0;
+	}
+}
+
+//
+// Compiled model
+//
+// Data derived from a model once, at load time or by the caller before
+// predicting, to make each prediction cheaper. svm_train does not compile
+// its models. A linear model is folded into one weight vector per
+// decision function, w = sum_i coef_i*SV_i, so that a decision value costs
+// a single dot product instead of one per SV. w is stored densely unless
+// that takes more memory than both the SVs and twice a sparse w.
+//
+// A polynomial model of degree <= 3 is expanded into its explicit feature
+// map: (gamma*x'*s+coef0)^degree is a sum of the order m forms of x'*s,
+// so sum_i coef_i*K(x,SV_i) is a constant plus a linear, a quadratic and a
+// cubic form of x, stored as symmetric tensors (entries with a <= b <= c)
+// with the multiplicities and gamma, coef0 folded in. This is used when the
+// tensors are smaller than the SVs and fit in POLY_MAP_MAX doubles.
+//
+// Summation order differs from the kernel expansion, so nothing is folded
+// with LIBSVM_STRICT_LIBM.
+//
+// With early_termination, SVs of a binary RBF or sigmoid model are also
+// kept in decreasing order of |coef|, with the range of the sum of the
+// remaining terms (K is in [0,1] for RBF and [-1,1] for sigmoid), so that
+// svm_predict can stop once the sign of the decision value is known.
+//
+// With tree_tolerance, SVs of an RBF model are indexed by a ball tree: each
+// node has an SV as center and the radius of its SVs around it. Prediction
+// skips nodes whose SVs are all farther than R from x, where
+// exp(-gamma*R^2) = tree_tolerance, so each decision value is off by at
+// most tree_tolerance times the sum of its |coef|.
+//
+// With sv_precision SV_FLOAT32 or SV_INT8, the dense copy of the SVs keeps
+// floats, or int8 values times a per-feature scale (the largest |value| of
+// the feature over 127), taking 1/2 or 1/8 of the memory of doubles.
+// svm_predict_dense and the prediction of single samples use it, so the
+// decision values are those of the rounded SVs, and the svm_node rows are
+// no longer needed unless early termination or a ball tree is compiled
+// (see svm_compiled_model_needs_sv).
+//
+#define POLY_MAP_MAX (1L<<22)
+
+struct svm_compiled_model
+{
+	int nr_dec;		// number of decision functions
+	int w_dim;		// length of each dense w, 0 if not dense
+	double *w;		// w[p*w_dim+k], or NULL
+	svm_node **w_sparse;	// w_sparse[p] terminated by index -1, or NULL
+	int poly_dim;		// number of features of the polynomial map
+	long poly_size;		// doubles per decision function in poly
+	double *poly;		// constant, then forms of order 1..degree, or NULL
+	int sv_dim;		// largest feature index of the SVs
+	double *sv_dense;	// SV[i] densely at sv_dense[i*sv_dim], or NULL
+	float *sv_float;	// same for SV_FLOAT32, or NULL
+	signed char *sv_int8;	// same for SV_INT8, SV[i][k] ~ sv_int8[i*sv_dim+k]*sv_scale[k]
+	double *sv_scale;
+	double *sv_dense_square;	// squared norms of the rounded SVs for RBF, or NULL
+	double quantization_error;	// largest error of a rounded SV value
+	int *sv_dec;		// decision function of sv_coef[t][i] at sv_dec[i*(nr_class-1)+t]
+	double *sv_square;	// ||SV[i]||^2 for RBF, or NULL
+	const svm_node **sv_ordered;	// SVs in decreasing order of |coef|, or NULL
+	double *coef_ordered;
+	double *sv_square_ordered;
+	double *tail_low;	// bounds of the sum of terms t..l-1 in that order
+	double *tail_high;
+	int nr_tree_node;
+	struct ball_tree_node *tree;	// root at tree[0], or NULL
+	int *tree_index;	// SV indices, each node covers a range of them
+	const svm_node **tree_sv;	// SV[tree_index[i]]
+	double *tree_sv_square;	// ||SV[tree_index[i]]||^2, or NULL
+	double tree_radius;	// R
+	double error_bound;
+};
+
+#define BALL_TREE_LEAF 16
+
+struct ball_tree_node
+{
+	int center;		// SV index
+	double radius;
+	int begin, end;		// range of tree_index
+	int left, right;	// children, -1 for leaves
+};
+
+static bool has_dense_sv(const svm_compiled_model *cm)
+{
+	return cm->sv_dense || cm->sv_float || cm->sv_int8;
+}
+
+static bool is_single_output(const svm_model *model)
+{
+	return model->param.svm_type == ONE_CLASS ||
+	       model->param.svm_type == EPSILON_SVR ||
+	       model->param.svm_type == NU_SVR;
+}
+
+// coefficients of all SVs in decision function p, 0 for SVs of classes
+// not in it
+static void get_dec_coef(const svm_model *model, int p, double *coef)
+{
+	if(is_single_output(model))
+	{
+		memcpy(coef,model->sv_coef[0],sizeof(double)*model->l);
+		return;
+	}
+
+	int nr_class = model->nr_class;
+	int i, j, k, start = 0;
+	for(i=0;i<nr_class;i++)
+	{
+		if(p < nr_class-i-1)
+			break;
+		p -= nr_class-i-1;
+	}
+	j = i+1+p;
+
+	memset(coef,0,sizeof(double)*model->l);
+	for(k=0;k<nr_class;k++)
+	{
+		if(k == i)
+			memcpy(&coef[start],&model->sv_coef[j-1][start],sizeof(double)*model->nSV[k]);
+		else if(k == j)
+			memcpy(&coef[start],&model->sv_coef[i][start],sizeof(double)*model->nSV[k]);
+		start += model->nSV[k];
+	}
+}
+
+static void free_w_sparse(svm_compiled_model *cm)
+{
+	if(cm->w_sparse == NULL)
+		return;
+	for(int p=0;p<cm->nr_dec;p++)
+		free(cm->w_sparse[p]);
+	free(cm->w_sparse);
+	cm->w_sparse = NULL;
+}
+
+// position of (a,b), a <= b, in the packed quadratic form
+static inline long poly_index2(int dim, long a, long b)
+{
+	return a*dim - a*(a-1)/2 + (b-a);
+}
+
+// position of (a,b,c), a <= b <= c, in the packed cubic form; the block
+// of a starts after sum_{a'<a} (dim-a')(dim-a'+1)/2 = S(dim)-S(dim-a)
+// entries, S(n) = n(n+1)(n+2)/6
+static inline long poly_index3(int dim, long a, long b, long c)
+{
+	long r = dim-a;
+	return ((long)dim*(dim+1)*(dim+2) - r*(r+1)*(r+2))/6
+		+ (b-a)*dim - (a+b-1)*(b-a)/2 + (c-b);
+}
+
+// value of the polynomial map for the nonzero features idx[i] (increasing,
+// 0-based) and values val[i] of x
+static double poly_map_value(const double *map, int dim, int degree,
+			     const int *idx, const double *val, int n)
+{
+	double sum = map[0];
+	long n2 = degree >= 2 ? (long)dim*(dim+1)/2 : 0;
+	const double *w = &map[1];
+	const double *A = &map[1+dim];
+	const double *T = &map[1+dim+n2];
+	for(int i=0;i<n && degree >= 1;i++)
+	{
+		double s = w[idx[i]];
+		for(int j=i;j<n && degree >= 2;j++)
+		{
+			double s2 = A[poly_index2(dim,idx[i],idx[j])];
+			if(degree >= 3)
+			{
+				const double *T_ij = &T[poly_index3(dim,idx[i],idx[j],idx[j])];
+				for(int k=j;k<n;k++)
+					s2 += T_ij[idx[k]-idx[j]]*val[k];
+			}
+			s += s2*val[j];
+		}
+		sum += s*val[i];
+	}
+	return sum;
+}
+
+// largest feature index of the SVs, with their number of nonzeros; -1 if an
+// index is below 1, which weight vectors and dense copies cannot hold
+static int sv_max_index(const svm_model *model, long *nr_nonzero)
+{
+	int dim = 0;
+	*nr_nonzero = 0;
+	for(int k=0;k<model->l;k++)
+		for(const svm_node *px = model->SV[k]; px->index != -1; ++px)
+		{
+			if(px->index < 1)
+				return -1;
+			dim = max(dim,px->index);
+			++*nr_nonzero;
+		}
+	return dim;
+}
+
+#ifndef LIBSVM_STRICT_LIBM
+// Fold w of one decision function at a time in a dim-sized buffer into
+// w_sparse, then keep w dense instead if that takes no more memory than the
+// SVs or not much more than w_sparse. Allocation failures leave the model
+// unfolded.
+static void compile_linear(const svm_model *model, svm_compiled_model *cm)
+{
+	long nr_nonzero;
+	int dim = sv_max_index(model,&nr_nonzero);
+	if(dim <= 0)
+		return;
+
+	double *w_p = Malloc(double,dim);
+	double *coef = Malloc(double,model->l);
+	cm->w_sparse = (svm_node **)calloc(cm->nr_dec,sizeof(svm_node *));
+	if(w_p == NULL || coef == NULL || cm->w_sparse == NULL)
+	{
+		free(w_p);
+		free(coef);
+		free(cm->w_sparse);
+		cm->w_sparse = NULL;
+		return;
+	}
+
+	size_t nnz = 0;
+	int p, k;
+	for(p=0;p<cm->nr_dec;p++)
+	{
+		memset(w_p,0,sizeof(double)*dim);
+		get_dec_coef(model,p,coef);
+		for(k=0;k<model->l;k++)
+			if(coef[k] != 0)
+				for(const svm_node *px = model->SV[k]; px->index != -1; ++px)
+					w_p[px->index-1] += coef[k]*px->value;
+
+		int n = 0;
+		for(k=0;k<dim;k++)
+			if(w_p[k] != 0)
+				++n;
+		svm_node *node = Malloc(svm_node,n+1);
+		if(node == NULL)
+			break;
+		n = 0;
+		for(k=0;k<dim;k++)
+			if(w_p[k] != 0)
+			{
+				node[n].index = k+1;
+				node[n].value = w_p[k];
+				++n;
+			}
+		node[n].index = -1;
+		cm->w_sparse[p] = node;
+		nnz += n;
+	}
+	free(w_p);
+	free(coef);
+	if(p < cm->nr_dec)
+	{
+		free_w_sparse(cm);
+		return;
+	}
+
+	double dense_bytes = (double)cm->nr_dec*dim*sizeof(double);
+	if(dense_bytes > (double)nr_nonzero*sizeof(svm_node) &&
+	   dense_bytes > (double)nnz*sizeof(svm_node)*2)
+		return;
+
+	double *w = Malloc(double,(size_t)cm->nr_dec*dim);
+	if(w == NULL)
+		return;
+	memset(w,0,sizeof(double)*(size_t)cm->nr_dec*dim);
+	for(p=0;p<cm->nr_dec;p++)
+		for(const svm_node *px = cm->w_sparse[p]; px->index != -1; ++px)
+			w[(size_t)p*dim+px->index-1] = px->value;
+	free_w_sparse(cm);
+	cm->w_dim = dim;
+	cm->w = w;
+}
+
+// number of coefficients of the forms of order 0..degree in dim features,
+// or POLY_MAP_MAX+1 if there are more than POLY_MAP_MAX. It is counted in
+// double, where it is exact up to POLY_MAP_MAX, so that large dim does not
+// overflow.
+static long poly_map_size(int dim, int degree)
+{
+	double size = 1, n = 1;
+	for(int m=1;m<=degree;m++)
+	{
+		n = n*((double)dim+m-1)/m;
+		size += n;
+		if(size > POLY_MAP_MAX)
+			return POLY_MAP_MAX+1;
+	}
+	return (long)size;
+}
+
+static void compile_poly(const svm_model *model, svm_compiled_model *cm)
+{
+	int degree = model->param.degree;
+	if(degree < 0 || degree > 3)
+		return;
+
+	long nr_nonzero;
+	int dim = sv_max_index(model,&nr_nonzero);
+	if(dim < 0)
+		return;
+	long size = poly_map_size(dim,degree);
+	if(size > POLY_MAP_MAX/cm->nr_dec || size >= nr_nonzero)
+		return;
+
+	// C(degree,m)*gamma^m*coef0^(degree-m) for the form of order m
+	double scale[4];
+	for(int m=0;m<=degree;m++)
+	{
+		double binom = 1;
+		for(int r=0;r<m;r++)
+			binom = binom*(degree-r)/(r+1);
+		scale[m] = binom*powi(model->param.gamma,m)*powi(model->param.coef0,degree-m);
+	}
+
+	long n2 = degree >= 2 ? (long)dim*(dim+1)/2 : 0;
+	double *poly = Malloc(double,size*cm->nr_dec);
+	double *coef = Malloc(double,model->l);
+	if(poly == NULL || coef == NULL)
+	{
+		free(poly);
+		free(coef);
+		return;
+	}
+	memset(poly,0,sizeof(double)*size*cm->nr_dec);
+	for(int p=0;p<cm->nr_dec;p++)
+	{
+		double *map = &poly[p*size];
+		double *w = &map[1];
+		double *A = &map[1+dim];
+		double *T = &map[1+dim+n2];
+		get_dec_coef(model,p,coef);
+		for(int k=0;k<model->l;k++)
+		{
+			if(coef[k] == 0)
+				continue;
+			map[0] += coef[k];
+			for(const svm_node *pa = model->SV[k]; degree >= 1 && pa->index != -1; ++pa)
+			{
+				int a = pa->index-1;
+				double ca = coef[k]*pa->value;
+				w[a] += ca;
+				for(const svm_node *pb = pa; degree >= 2 && pb->index != -1; ++pb)
+				{
+					int b = pb->index-1;
+					double cab = ca*pb->value;
+					A[poly_index2(dim,a,b)] += (a == b ? 1 : 2)*cab;
+					for(const svm_node *pc = pb; degree >= 3 && pc->index != -1; ++pc)
+					{
+						int c = pc->index-1;
+						double mult = (a == b && b == c) ? 1 : ((a == b || b == c) ? 3 : 6);
+						T[poly_index3(dim,a,b,c)] += mult*cab*pc->value;
+					}
+				}
+			}
+		}
+
+		map[0] *= scale[0];
+		long offset = 1, n = 1;
+		for(int m=1;m<=degree;m++)
+		{
+			n = n*(dim+m-1)/m;
+			for(long t=0;t<n;t++)
+				map[offset+t] *= scale[m];
+			offset += n;
+		}
+	}
+	free(coef);
+
+	cm->poly_dim = dim;
+	cm->poly_size = size;
+	cm->poly = poly;
+}
+
+// dense copy of the SVs for svm_predict_dense, if it takes no more memory
+// than the svm_node rows
+static void compile_dense_sv(const svm_model *model, svm_compiled_model *cm, int sv_precision)
+{
+	int l = model->l;
+	long nr_nonzero;
+	int dim = sv_max_index(model,&nr_nonzero);
+	int i, k;
+	size_t value_size = sv_precision == SV_INT8 ? sizeof(signed char) :
+			    sv_precision == SV_FLOAT32 ? sizeof(float) : sizeof(double);
+	if(dim <= 0 || (double)l*dim*value_size > (double)nr_nonzero*sizeof(svm_node))
+		return;
+
+	// allocate everything first; if any allocation fails, the SVs stay sparse
+	size_t size = (size_t)l*dim;
+	int nr_class = model->nr_class;
+	bool need_square = model->param.kernel_type == RBF && sv_precision != SV_FLOAT64;
+	void *values = malloc(size*value_size);
+	double *sv_scale = sv_precision == SV_INT8 ? Malloc(double,dim) : NULL;
+	double *square = need_square ? Malloc(double,l) : NULL;
+	int *sv_dec = Malloc(int,is_single_output(model) ? (size_t)l : (size_t)l*(nr_class-1));
+	if(values == NULL || (sv_precision == SV_INT8 && sv_scale == NULL) || (need_square && square == NULL) || sv_dec == NULL)
+	{
+		free(values);
+		free(sv_scale);
+		free(square);
+		free(sv_dec);
+		return;
+	}
+
+	cm->sv_dim = dim;
+	cm->sv_dec = sv_dec;
+	if(sv_precision == SV_FLOAT32)
+	{
+		cm->sv_float = (float *)values;
+		memset(cm->sv_float,0,sizeof(float)*size);
+		for(i=0;i<l;i++)
+			for(const svm_node *px = model->SV[i]; px->index != -1; ++px)
+			{
+				float v = (float)px->value;
+				cm->sv_float[(size_t)i*dim+px->index-1] = v;
+				cm->quantization_error = max(cm->quantization_error,fabs(px->value-(double)v));
+			}
+	}
+	else if(sv_precision == SV_INT8)
+	{
+		cm->sv_scale = sv_scale;
+		for(k=0;k<dim;k++)
+			cm->sv_scale[k] = 0;
+		for(i=0;i<l;i++)
+			for(const svm_node *px = model->SV[i]; px->index != -1; ++px)
+				cm->sv_scale[px->index-1] = max(cm->sv_scale[px->index-1],fabs((double)px->value));
+		for(k=0;k<dim;k++)
+			cm->sv_scale[k] /= 127;
+
+		cm->sv_int8 = (signed char *)values;
+		memset(cm->sv_int8,0,size);
+		for(i=0;i<l;i++)
+			for(const svm_node *px = model->SV[i]; px->index != -1; ++px)
+			{
+				double scale = cm->sv_scale[px->index-1];
+				if(scale == 0)
+					continue;
+				double q = min(max(floor(px->value/scale+0.5),-127.0),127.0);
+				cm->sv_int8[(size_t)i*dim+px->index-1] = (signed char)q;
+				cm->quantization_error = max(cm->quantization_error,fabs(px->value-q*scale));
+			}
+	}
+	else
+	{
+		cm->sv_dense = (double *)values;
+		memset(cm->sv_dense,0,sizeof(double)*size);
+		for(i=0;i<l;i++)
+			for(const svm_node *px = model->SV[i]; px->index != -1; ++px)
+				cm->sv_dense[(size_t)i*dim+px->index-1] = px->value;
+	}
+
+	if(need_square)
+	{
+		cm->sv_dense_square = square;
+		for(i=0;i<l;i++)
+		{
+			double sum = 0;
+			for(k=0;k<dim;k++)
+			{
+				double v = cm->sv_float ? cm->sv_float[(size_t)i*dim+k] :
+					   cm->sv_int8[(size_t)i*dim+k]*cm->sv_scale[k];
+				sum += v*v;
+			}
+			cm->sv_dense_square[i] = sum;
+		}
+	}
+
+	if(is_single_output(model))
+	{
+		for(i=0;i<l;i++)
+			cm->sv_dec[i] = 0;
+		return;
+	}
+
+	// SV of class c: sv_coef[t] is its coefficient against class t (t < c)
+	// or t+1 (t >= c)
+	i = 0;
+	for(int c=0;c<nr_class;c++)
+		for(k=0;k<model->nSV[c];k++,i++)
+			for(int t=0;t<nr_class-1;t++)
+			{
+				int a = min(c,t < c ? t : t+1);
+				int b = max(c,t < c ? t : t+1);
+				cm->sv_dec[(size_t)i*(nr_class-1)+t] = a*(nr_class-1) - a*(a-1)/2 + b-a-1;
+			}
+}
+#endif
+
+struct coef_order
+{
+	double abs_coef;
+	int index;
+};
+
+static int compare_coef_order(const void *a, const void *b)
+{
+	const coef_order *p = (const coef_order *)a, *q = (const coef_order *)b;
+	if(p->abs_coef != q->abs_coef)
+		return p->abs_coef > q->abs_coef ? -1 : 1;
+	return p->index - q->index;
+}
+
+static void compile_early_termination(const svm_model *model, svm_compiled_model *cm)
+{
+	int kernel_type = model->param.kernel_type;
+	int svm_type = model->param.svm_type;
+	if(cm->nr_dec != 1 || (kernel_type != RBF && kernel_type != SIGMOID) ||
+	   svm_type == EPSILON_SVR || svm_type == NU_SVR)
+		return;
+
+	int l = model->l;
+	int i;
+	double *coef = Malloc(double,l);
+	coef_order *order = Malloc(coef_order,l);
+	get_dec_coef(model,0,coef);
+	for(i=0;i<l;i++)
+	{
+		order[i].abs_coef = fabs(coef[i]);
+		order[i].index = i;
+	}
+	qsort(order,l,sizeof(coef_order),compare_coef_order);
+
+	cm->sv_ordered = Malloc(const svm_node *,l);
+	cm->coef_ordered = Malloc(double,l);
+	cm->sv_square_ordered = cm->sv_square ? Malloc(double,l) : NULL;
+	cm->tail_low = Malloc(double,l+1);
+	cm->tail_high = Malloc(double,l+1);
+	for(i=0;i<l;i++)
+	{
+		cm->sv_ordered[i] = model->SV[order[i].index];
+		cm->coef_ordered[i] = coef[order[i].index];
+		if(cm->sv_square_ordered)
+			cm->sv_square_ordered[i] = cm->sv_square[order[i].index];
+	}
+	cm->tail_low[l] = 0;
+	cm->tail_high[l] = 0;
+	for(i=l-1;i>=0;i--)
+	{
+		double c = cm->coef_ordered[i];
+		if(kernel_type == RBF)
+		{
+			cm->tail_low[i] = cm->tail_low[i+1] + min(c,0.0);
+			cm->tail_high[i] = cm->tail_high[i+1] + max(c,0.0);
+		}
+		else
+		{
+			cm->tail_low[i] = cm->tail_low[i+1] - fabs(c);
+			cm->tail_high[i] = cm->tail_high[i+1] + fabs(c);
+		}
+	}
+	free(order);
+	free(coef);
+}
+
+// a node for tree_index[begin,end), which is split at *mid into the ranges
+// of its children, or *mid = -1 for a leaf; returns the node
+static int make_ball_tree_node(const svm_model *model, svm_compiled_model *cm, int begin, int end,
+			       double *dist, double *centroid, int dim, int *mid)
+{
+	int *idx = cm->tree_index;
+	int i, k;
+
+	// center: the SV nearest to the centroid
+	for(k=0;k<dim;k++)
+		centroid[k] = 0;
+	for(i=begin;i<end;i++)
+		for(const svm_node *px = model->SV[idx[i]]; px->index != -1; ++px)
+			centroid[px->index-1] += px->value/(end-begin);
+	int center = idx[begin];
+	double center_dist = INF;
+	for(i=begin;i<end;i++)
+	{
+		double d = 0;
+		int last = 0;
+		for(const svm_node *px = model->SV[idx[i]]; px->index != -1; ++px)
+		{
+			for(k=last;k<px->index-1;k++)
+				d += centroid[k]*centroid[k];
+			d += (px->value-centroid[px->index-1])*(px->value-centroid[px->index-1]);
+			last = px->index;
+		}
+		for(k=last;k<dim;k++)
+			d += centroid[k]*centroid[k];
+		if(d < center_dist)
+		{
+			center_dist = d;
+			center = idx[i];
+		}
+	}
+
+	int node = cm->nr_tree_node++;
+	double radius = 0;
+	int far = begin;
+	for(i=begin;i<end;i++)
+	{
+		dist[i] = sqrt(Kernel::squared_distance(model->SV[center],model->SV[idx[i]]));
+		if(dist[i] > radius)
+		{
+			radius = dist[i];
+			far = i;
+		}
+	}
+	cm->tree[node].center = center;
+	cm->tree[node].radius = radius;
+	cm->tree[node].begin = begin;
+	cm->tree[node].end = end;
+	cm->tree[node].left = -1;
+	cm->tree[node].right = -1;
+	*mid = -1;
+	if(end-begin <= BALL_TREE_LEAF || radius == 0)
+		return node;
+
+	// split by the nearer of a (farthest from center) and b (farthest from a)
+	const svm_node *a = model->SV[idx[far]];
+	double max_dist = -1;
+	const svm_node *b = a;
+	for(i=begin;i<end;i++)
+	{
+		dist[i] = Kernel::squared_distance(a,model->SV[idx[i]]);
+		if(dist[i] > max_dist)
+		{
+			max_dist = dist[i];
+			b = model->SV[idx[i]];
+		}
+	}
+	int split = begin;
+	for(i=begin;i<end;i++)
+		if(dist[i] <= Kernel::squared_distance(b,model->SV[idx[i]]))
+		{
+			swap(idx[i],idx[split]);
+			++split;
+		}
+	if(split != begin && split != end)
+		*mid = split;
+	return node;
+}
+
+struct ball_tree_range
+{
+	int begin, end;
+	int parent;		// node that takes this range as a child, -1 for the root
+	bool right;
+};
+
+// split tree_index[0,l) into nodes in preorder, with an explicit stack, as
+// unbalanced splits can make the tree nearly l deep
+static void build_ball_tree(const svm_model *model, svm_compiled_model *cm, double *dist,
+			    double *centroid, int dim)
+{
+	// each range on the stack is the right child of a distinct ancestor,
+	// except the one pushed last
+	ball_tree_range *stack = Malloc(ball_tree_range,model->l);
+	int nr_stack = 0;
+	stack[nr_stack].begin = 0;
+	stack[nr_stack].end = model->l;
+	stack[nr_stack].parent = -1;
+	stack[nr_stack++].right = false;
+	while(nr_stack > 0)
+	{
+		ball_tree_range r = stack[--nr_stack];
+		int mid;
+		int node = make_ball_tree_node(model,cm,r.begin,r.end,dist,centroid,dim,&mid);
+		if(r.parent != -1)
+		{
+			if(r.right)
+				cm->tree[r.parent].right = node;
+			else
+				cm->tree[r.parent].left = node;
+		}
+		if(mid == -1)
+			continue;
+		stack[nr_stack].begin = mid;
+		stack[nr_stack].end = r.end;
+		stack[nr_stack].parent = node;
+		stack[nr_stack++].right = true;
+		stack[nr_stack].begin = r.begin;
+		stack[nr_stack].end = mid;
+		stack[nr_stack].parent = node;
+		stack[nr_stack++].right = false;
+	}
+	free(stack);
+}
+
+static void compile_ball_tree(const svm_model *model, svm_compiled_model *cm, double tolerance)
+{
+	int l = model->l;
+	if(model->param.kernel_type != RBF || model->param.gamma <= 0 ||
+	   tolerance <= 0 || tolerance >= 1 || l <= BALL_TREE_LEAF)
+		return;
+
+	long nr_nonzero;
+	int dim = sv_max_index(model,&nr_nonzero);
+	if(dim < 0)
+		return;
+
+	int i;
+	cm->tree = Malloc(ball_tree_node,2*l);
+	cm->tree_index = Malloc(int,l);
+	for(i=0;i<l;i++)
+		cm->tree_index[i] = i;
+	double *dist = Malloc(double,l);
+	double *centroid = Malloc(double,max(dim,1));
+	build_ball_tree(model,cm,dist,centroid,dim);
+	free(dist);
+	free(centroid);
+
+	cm->tree_sv = Malloc(const svm_node *,l);
+	cm->tree_sv_square = cm->sv_square ? Malloc(double,l) : NULL;
+	for(i=0;i<l;i++)
+	{
+		cm->tree_sv[i] = model->SV[cm->tree_index[i]];
+		if(cm->tree_sv_square)
+			cm->tree_sv_square[i] = cm->sv_square[cm->tree_index[i]];
+	}
+	cm->tree_radius = sqrt(-log(tolerance)/model->param.gamma);
+
+	double *coef = Malloc(double,l);
+	for(int p=0;p<cm->nr_dec;p++)
+	{
+		double sum = 0;
+		get_dec_coef(model,p,coef);
+		for(i=0;i<l;i++)
+			sum += fabs(coef[i]);
+		cm->error_bound = max(cm->error_bound,tolerance*sum);
+	}
+	free(coef);
+}
+
+// kvalue[i] for SVs within the tree radius of x, 0 for the others
+// stack has nr_tree_node ints
+static void ball_tree_kernel_values(const svm_model *model, const svm_node *x, double *kvalue,
+				    int *stack)
+{
+	const svm_compiled_model *cm = model->compiled;
+	int nr_stack = 0;
+	for(int i=0;i<model->l;i++)
+		kvalue[i] = 0;
+	stack[nr_stack++] = 0;
+	while(nr_stack > 0)
+	{
+		const ball_tree_node& node = cm->tree[stack[--nr_stack]];
+		double d = sqrt(Kernel::squared_distance(x,model->SV[node.center]));
+		if(d - node.radius > cm->tree_radius)
+			continue;
+		if(node.left != -1)
+		{
+			stack[nr_stack++] = node.right;
+			stack[nr_stack++] = node.left;
+			continue;
+		}
+		int n = node.end-node.begin;
+		double leaf_value[BALL_TREE_LEAF];
+		if(n > BALL_TREE_LEAF)
+		{
+			// a leaf of identical SVs
+			double k = Kernel::k_function(x,model->SV[node.center],model->param);
+			for(int i=node.begin;i<node.end;i++)
+				kvalue[cm->tree_index[i]] = k;
+			continue;
+		}
+		Kernel::k_function_values(x,&cm->tree_sv[node.begin],n,model->param,leaf_value,
+					  cm->tree_sv_square ? &cm->tree_sv_square[node.begin] : NULL);
+		for(int i=0;i<n;i++)
+			kvalue[cm->tree_index[node.begin+i]] = leaf_value[i];
+	}
+}
+
+void svm_compile_model(svm_model *model, const svm_compile_parameter *cparam)
+{
+	svm_free_compiled_model(model);
+	if(model->l <= 0 || model->SV == NULL || model->sv_coef == NULL ||
+	   (!is_single_output(model) && model->nSV == NULL))
+		return;
+
+	svm_compiled_model *cm = Malloc(svm_compiled_model,1);
+	cm->nr_dec = is_single_output(model) ? 1 : model->nr_class*(model->nr_class-1)/2;
+	cm->w_dim = 0;
+	cm->w = NULL;
+	cm->w_sparse = NULL;
+	cm->poly_dim = 0;
+	cm->poly_size = 0;
+	cm->poly = NULL;
+	cm->sv_dim = 0;
+	cm->sv_dense = NULL;
+	cm->sv_float = NULL;
+	cm->sv_int8 = NULL;
+	cm->sv_scale = NULL;
+	cm->sv_dense_square = NULL;
+	cm->quantization_error = 0;
+	cm->sv_dec = NULL;
+	cm->sv_square = NULL;
+	cm->sv_ordered = NULL;
+	cm->coef_ordered = NULL;
+	cm->sv_square_ordered = NULL;
+	cm->tail_low = NULL;
+	cm->tail_high = NULL;
+	cm->nr_tree_node = 0;
+	cm->tree = NULL;
+	cm->tree_index = NULL;
+	cm->tree_sv = NULL;
+	cm->tree_sv_square = NULL;
+	cm->tree_radius = 0;
+	cm->error_bound = 0;
+#ifndef LIBSVM_STRICT_LIBM
+	if(model->param.kernel_type == LINEAR)
+		compile_linear(model,cm);
+	else if(model->param.kernel_type == POLY)
+		compile_poly(model,cm);
+	if(cm->w == NULL && cm->w_sparse == NULL && cm->poly == NULL &&
+	   model->param.kernel_type != PRECOMPUTED)
+		compile_dense_sv(model,cm,cparam ? cparam->sv_precision : SV_FLOAT64);
+	if(model->param.kernel_type == RBF)
+	{
+		// ||x-SV[i]||^2 = ||x||^2+||SV[i]||^2-2*x'*SV[i], as in training
+		cm->sv_square = Malloc(double,model->l);
+		for(int i=0;i<model->l;i++)
+			cm->sv_square[i] = Kernel::dot(model->SV[i],model->SV[i]);
+	}
+#endif
+	if(cparam && cparam->early_termination)
+		compile_early_termination(model,cm);
+	if(cparam && cparam->tree_tolerance > 0)
+		compile_ball_tree(model,cm,cparam->tree_tolerance);
+	model->compiled = cm;
+}
+
+void svm_free_compiled_model(svm_model *model)
+{
+	svm_compiled_model *cm = model->compiled;
+	if(cm == NULL)
+		return;
+	free(cm->w);
+	free_w_sparse(cm);
+	free(cm->poly);
+	free(cm->sv_dense);
+	free(cm->sv_float);
+	free(cm->sv_int8);
+	free(cm->sv_scale);
+	free(cm->sv_dense_square);
+	free(cm->sv_dec);
+	free(cm->sv_square);
+	free(cm->sv_ordered);
+	free(cm->coef_ordered);
+	free(cm->sv_square_ordered);
+	free(cm->tail_low);
+	free(cm->tail_high);
+	free(cm->tree);
+	free(cm->tree_index);
+	free(cm->tree_sv);
+	free(cm->tree_sv_square);
+	free(cm);
+	model->compiled = NULL;
+}
+
+int svm_compiled_model_needs_sv(const svm_model *model)
+{
+	const svm_compiled_model *cm = model->compiled;
+	if(cm == NULL || cm->sv_ordered || cm->tree)
+		return 1;
+	return (cm->w || cm->w_sparse || cm->poly || cm->sv_float || cm->sv_int8) ? 0 : 1;
+}
+
+void svm_get_compiled_model_info(const svm_model *model, svm_compiled_model_info *info)
+{
+	const svm_compiled_model *cm = model->compiled;
+	info->weight_vector = cm && (cm->w || cm->w_sparse);
+	info->polynomial_map = cm && cm->poly;
+	info->dense_sv = cm && has_dense_sv(cm);
+	info->sv_precision = cm && cm->sv_float ? SV_FLOAT32 : cm && cm->sv_int8 ? SV_INT8 : SV_FLOAT64;
+	info->sv_bytes = 0;
+	if(cm && has_dense_sv(cm))
+		info->sv_bytes = (long)model->l*cm->sv_dim*(cm->sv_float ? sizeof(float) :
+							    cm->sv_int8 ? sizeof(signed char) : sizeof(double));
+	info->quantization_error = cm ? cm->quantization_error : 0;
+	info->sv_node_bytes = 0;
+	if(model->SV)
+		for(int i=0;i<model->l;i++)
+		{
+			const svm_node *px = model->SV[i];
+			while(px->index != -1)
+				++px;
+			info->sv_node_bytes += (long)(px-model->SV[i]+1)*sizeof(svm_node);
+		}
+	info->early_termination = cm && cm->sv_ordered;
+	info->tree_nodes = cm ? cm->nr_tree_node : 0;
+	info->error_bound = cm ? cm->error_bound : 0;
+}
+
+// decision value of a binary model with early termination: kernel values
+// are computed in blocks, in decreasing order of |coef|, until the
+// remaining terms cannot change the sign of the sum
+#define EARLY_TERMINATION_BLOCK 16
+
+static double predict_early_termination(const svm_model *model, const svm_node *x)
+{
+	const svm_compiled_model *cm = model->compiled;
+	double kvalue[EARLY_TERMINATION_BLOCK];
+	double sum = -model->rho[0];
+	for(int t=0;t<model->l;t+=EARLY_TERMINATION_BLOCK)
+	{
+		int m = min(EARLY_TERMINATION_BLOCK,model->l-t);
+		Kernel::k_function_values(x,&cm->sv_ordered[t],m,model->param,kvalue,
+					  cm->sv_square_ordered ? &cm->sv_square_ordered[t] : NULL);
+		for(int k=0;k<m;k++)
+			sum += cm->coef_ordered[t+k]*kvalue[k];
+		if(sum + cm->tail_low[t+m] > 0 || sum + cm->tail_high[t+m] <= 0)
+			break;
+	}
+	return sum;
+}
+
+// kernel values of x and all SVs; work has nr_tree_node doubles for the
+// stack of the ball tree
+static void predict_kernel_values(const svm_model *model, const svm_node *x, double *kvalue,
+				  double *work)
+{
+	const svm_compiled_model *cm = model->compiled;
+	if(cm && cm->tree)
+		ball_tree_kernel_values(model,x,kvalue,(int *)work);
+	else
+		Kernel::k_function_values(x,model->SV,model->l,model->param,kvalue,
+					  cm ? cm->sv_square : NULL);
+}
+
+#define PREDICT_TILE_X 32
+#define PREDICT_TILE_SV 128
+#define PREDICT_TILE_DIM 256
+
+static void predict_dense_tile(const svm_model *model, const double *x, int n, int dim,
+			       const double *x_square, double *tile, double *x_scaled,
+			       double *dec_values);
+
+// doubles of the scratch of predict_rounded_sv
+static size_t rounded_sv_scratch_size(const svm_compiled_model *cm)
+{
+	return (size_t)cm->sv_dim+PREDICT_TILE_SV+PREDICT_TILE_DIM;
+}
+
+// doubles of the work memory of predict_decision_values (an int takes a
+// double)
+static size_t predict_work_size(const svm_model *model)
+{
+	const svm_compiled_model *cm = model->compiled;
+	size_t size = model->l;
+	if(cm && cm->tree)
+		size += cm->nr_tree_node;
+	if(cm && cm->poly)
+		size = max(size,2*(size_t)cm->poly_dim);
+	if(cm && (cm->sv_float || cm->sv_int8) && !cm->tree)
+		size = max(size,rounded_sv_scratch_size(cm));
+	return size > 0 ? size : 1;
+}
+
+// decision values of one sample from the rounded dense SVs, with the scratch
+// of rounded_sv_scratch_size doubles; features beyond the SVs only add to
+// the squared norm of the sample
+static void predict_rounded_sv(const svm_model *model, const svm_node *x, double *dec_values,
+			       double *scratch)
+{
+	const svm_compiled_model *cm = model->compiled;
+	int dim = cm->sv_dim;
+	double *xd = scratch;
+	double *tile = &scratch[dim];
+	double *x_scaled = &tile[PREDICT_TILE_SV];
+	double x_square = 0;
+	memset(xd,0,sizeof(double)*dim);
+	for(const svm_node *px = x; px->index != -1; ++px)
+		if(px->index >= 1 && px->index <= dim)
+			xd[px->index-1] = px->value;
+		else if(px->index > dim)
+			x_square += px->value*px->value;
+	x_square += Kernel::dot(xd,xd,dim);
+	memset(dec_values,0,sizeof(double)*cm->nr_dec);
+	predict_dense_tile(model,xd,1,dim,&x_square,tile,x_scaled,dec_values);
+	for(int p=0;p<cm->nr_dec;p++)
+		dec_values[p] -= model->rho[p];
+}
+
+// decision values of all decision functions; if sign_only, only the signs
+// of the values are exact when the model is compiled with early termination.
+// work has predict_work_size doubles.
+static void predict_decision_values(const svm_model *model, const svm_node *x, double *dec_values,
+				    bool sign_only, double *work)
+{
+	const svm_compiled_model *cm = model->compiled;
+	int i;
+	if(sign_only && cm && cm->sv_ordered)
+	{
+		*dec_values = predict_early_termination(model,x);
+		return;
+	}
+	if(cm && (cm->w || cm->w_sparse))
+	{
+		for(int p=0;p<cm->nr_dec;p++)
+		{
+			double sum = 0;
+			if(cm->w)
+			{
+				const double *w_p = &cm->w[(size_t)p*cm->w_dim];
+				for(const svm_node *px = x; px->index != -1; ++px)
+					if(px->index >= 1 && px->index <= cm->w_dim)
+						sum += w_p[px->index-1]*px->value;
+			}
+			else
+				sum = Kernel::dot(cm->w_sparse[p],x);
+			dec_values[p] = sum - model->rho[p];
+		}
+		return;
+	}
+	if(cm && cm->poly)
+	{
+		// the features of x in the map, at most poly_dim of them
+		double *val = work;
+		int *idx = (int *)&work[cm->poly_dim];
+		int n = 0;
+		for(const svm_node *px = x; px->index != -1 && n < cm->poly_dim; ++px)
+			if(px->index >= 1 && px->index <= cm->poly_dim)
+			{
+				idx[n] = px->index-1;
+				val[n] = px->value;
+				++n;
+			}
+		for(int p=0;p<cm->nr_dec;p++)
+			dec_values[p] = poly_map_value(&cm->poly[p*cm->poly_size],cm->poly_dim,
+						       model->param.degree,idx,val,n) - model->rho[p];
+		return;
+	}
+	if(cm && (cm->sv_float || cm->sv_int8) && !cm->tree)
+	{
+		predict_rounded_sv(model,x,dec_values,work);
+		return;
 	}
-}
 
-double svm_predict_values(const svm_model *model, const svm_node *x, double* dec_values)
-{
-	int i;
-	if(model->param.svm_type == ONE_CLASS ||
-	   model->param.svm_type == EPSILON_SVR ||
-	   model->param.svm_type == NU_SVR)
+	if(is_single_output(model))
 	{
 		double *sv_coef = model->sv_coef[0];
+		double *kvalue = work;
+		predict_kernel_values(model,x,kvalue,&work[model->l]);
 		double sum = 0;
 		for(i=0;i<model->l;i++)
-			sum += sv_coef[i] * Kernel::k_function(x,model->SV[i],model->param);
+			sum += sv_coef[i] * kvalue[i];
 		sum -= model->rho[0];
 		*dec_values = sum;
-
-		if(model->param.svm_type == ONE_CLASS)
-			return (sum>0)?1:-1;
-		else
-			return sum;
 	}
 	else
 	{
 		int nr_class = model->nr_class;
 		int l = model->l;
 
-		double *kvalue = Malloc(double,l);
-		for(i=0;i<l;i++)
-			kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
-
-		int *start = Malloc(int,nr_class);
-		start[0] = 0;
-		for(i=1;i<nr_class;i++)
-			start[i] = start[i-1]+model->nSV[i-1];
-
-		int *vote = Malloc(int,nr_class);
-		for(i=0;i<nr_class;i++)
-			vote[i] = 0;
+		double *kvalue = work;
+		predict_kernel_values(model,x,kvalue,&work[l]);
 
+		// si and sj are the starts of the SVs of classes i and j
 		int p=0;
+		int si=0;
 		for(i=0;i<nr_class;i++)
+		{
+			int sj = si+model->nSV[i];
 			for(int j=i+1;j<nr_class;j++)
 			{
 				double sum = 0;
-				int si = start[i];
-				int sj = start[j];
 				int ci = model->nSV[i];
 				int cj = model->nSV[j];
 
@@ -2554,7 +4690,36 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 					sum += coef2[sj+k] * kvalue[sj+k];
 				sum -= model->rho[p];
 				dec_values[p] = sum;
+				p++;
+				sj += cj;
+			}
+			si += model->nSV[i];
+		}
+	}
+}
+
+// label (or value) predicted from the decision values; vote has nr_class
+// doubles
+static double predict_label(const svm_model *model, const double *dec_values, double *vote)
+{
+	int i;
+	if(is_single_output(model))
+	{
+		if(model->param.svm_type == ONE_CLASS)
+			return (*dec_values>0)?1:-1;
+		else
+			return *dec_values;
+	}
+	else
+	{
+		int nr_class = model->nr_class;
+		for(i=0;i<nr_class;i++)
+			vote[i] = 0;
 
+		int p=0;
+		for(i=0;i<nr_class;i++)
+			for(int j=i+1;j<nr_class;j++)
+			{
 				if(dec_values[p] > 0)
 					++vote[i];
 				else
@@ -2567,26 +4732,87 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 			if(vote[i] > vote[vote_max_idx])
 				vote_max_idx = i;
 
-		free(kvalue);
-		free(start);
-		free(vote);
 		return model->label[vote_max_idx];
 	}
 }
 
+// scratch: votes (nr_class), decision values (for svm_predict_scratch),
+// and the work memory of predict_decision_values
+long svm_predict_scratch_size(const svm_model *model)
+{
+	int nr_class = model->nr_class;
+	return (long)(nr_class + nr_class*(nr_class-1)/2 + predict_work_size(model));
+}
+
+double svm_predict_values_scratch(const svm_model *model, const svm_node *x, double *dec_values,
+				  double *scratch)
+{
+	int nr_class = model->nr_class;
+	double *work = &scratch[nr_class + nr_class*(nr_class-1)/2];
+	predict_decision_values(model,x,dec_values,false,work);
+	return predict_label(model,dec_values,scratch);
+}
+
+double svm_predict_scratch(const svm_model *model, const svm_node *x, double *scratch)
+{
+	int nr_class = model->nr_class;
+	double *dec_values = &scratch[nr_class];
+	double *work = &scratch[nr_class + nr_class*(nr_class-1)/2];
+	predict_decision_values(model,x,dec_values,true,work);
+	return predict_label(model,dec_values,scratch);
+}
+
+double svm_predict_values(const svm_model *model, const svm_node *x, double* dec_values)
+{
+	double *scratch = Malloc(double,svm_predict_scratch_size(model));
+	double pred_result = svm_predict_values_scratch(model,x,dec_values,scratch);
+	free(scratch);
+	return pred_result;
+}
+
 double svm_predict(const svm_model *model, const svm_node *x)
 {
+	double *scratch = Malloc(double,svm_predict_scratch_size(model));
+	double pred_result = svm_predict_scratch(model,x,scratch);
+	free(scratch);
+	return pred_result;
+}
+
+// probability estimates from the decision values of a C_SVC or NU_SVC
+// model with probability information; returns the most probable label
+static double predict_probability(const svm_model *model, const double *dec_values, double *prob_estimates)
+{
+	int i;
 	int nr_class = model->nr_class;
-	double *dec_values;
-	if(model->param.svm_type == ONE_CLASS ||
-	   model->param.svm_type == EPSILON_SVR ||
-	   model->param.svm_type == NU_SVR)
-		dec_values = Malloc(double, 1);
+
+	double min_prob=1e-7;
+	double **pairwise_prob=Malloc(double *,nr_class);
+	for(i=0;i<nr_class;i++)
+		pairwise_prob[i]=Malloc(double,nr_class);
+	int k=0;
+	for(i=0;i<nr_class;i++)
+		for(int j=i+1;j<nr_class;j++)
+		{
+			pairwise_prob[i][j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
+			pairwise_prob[j][i]=1-pairwise_prob[i][j];
+			k++;
+		}
+	if (nr_class == 2)
+	{
+		prob_estimates[0] = pairwise_prob[0][1];
+		prob_estimates[1] = pairwise_prob[1][0];
+	}
 	else
-		dec_values = Malloc(double, nr_class*(nr_class-1)/2);
-	double pred_result = svm_predict_values(model, x, dec_values);
-	free(dec_values);
-	return pred_result;
+		multiclass_probability(nr_class,pairwise_prob,prob_estimates);
+
+	int prob_max_idx = 0;
+	for(i=1;i<nr_class;i++)
+		if(prob_estimates[i] > prob_estimates[prob_max_idx])
+			prob_max_idx = i;
+	for(i=0;i<nr_class;i++)
+		free(pairwise_prob[i]);
+	free(pairwise_prob);
+	return model->label[prob_max_idx];
 }
 
 double svm_predict_probability(
@@ -2595,43 +4821,537 @@ double svm_predict_probability(
 	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
 	    model->probA!=NULL && model->probB!=NULL)
 	{
-		int i;
 		int nr_class = model->nr_class;
 		double *dec_values = Malloc(double, nr_class*(nr_class-1)/2);
-		svm_predict_values(model, x, dec_values);
+		double *work = Malloc(double, predict_work_size(model));
+		predict_decision_values(model, x, dec_values, false, work);
+		double pred_result = predict_probability(model, dec_values, prob_estimates);
+		free(dec_values);
+		free(work);
+		return pred_result;
+	}
+	else
+		return svm_predict(model, x);
+}
 
-		double min_prob=1e-7;
-		double **pairwise_prob=Malloc(double *,nr_class);
-		for(i=0;i<nr_class;i++)
-			pairwise_prob[i]=Malloc(double,nr_class);
-		int k=0;
-		for(i=0;i<nr_class;i++)
-			for(int j=i+1;j<nr_class;j++)
+//
+// Batch prediction of dense samples
+//
+// If the compiled model has a dense copy of the SVs, kernel values are
+// computed for a tile of PREDICT_TILE_X samples and PREDICT_TILE_SV SVs at
+// once: the dot products as a blocked matrix product X*S', then the kernel
+// function over the tile, then sv_coef is applied to the tile. Each decision
+// value still sums its terms in the order of the SVs. Otherwise each sample
+// is predicted by itself. Samples are split among the OpenMP threads.
+//
+// With float or int8 SVs, the products are summed in double; for int8 the
+// samples are multiplied by the per-feature scales first.
+//
+static double dot_float(const double *px, const float *py, int n)
+{
+	double sum = 0;
+SVM_OMP(omp simd reduction(+:sum))
+	for(int k=0;k<n;k++)
+		sum += px[k] * py[k];
+	return sum;
+}
+
+static double dot_int8(const double *px, const signed char *py, int n)
+{
+	double sum = 0;
+SVM_OMP(omp simd reduction(+:sum))
+	for(int k=0;k<n;k++)
+		sum += px[k] * py[k];
+	return sum;
+}
+
+// kernel values and decision values of the n samples of a tile, added to
+// dec_values; tile has PREDICT_TILE_X*PREDICT_TILE_SV doubles and x_scaled
+// PREDICT_TILE_DIM for int8 SVs
+static void predict_dense_tile(const svm_model *model, const double *x, int n, int dim,
+			       const double *x_square, double *tile, double *x_scaled,
+			       double *dec_values)
+{
+	const svm_compiled_model *cm = model->compiled;
+	const svm_parameter& param = model->param;
+	int l = model->l;
+	int sv_dim = cm->sv_dim;
+	int d = min(dim,sv_dim);
+	int nr_dec = cm->nr_dec;
+	int nr_coef = is_single_output(model) ? 1 : model->nr_class-1;
+	int ii, jj;
+
+	const double *sv_square = cm->sv_dense_square ? cm->sv_dense_square : cm->sv_square;
+
+	for(int j0=0;j0<l;j0+=PREDICT_TILE_SV)
+	{
+		int j1 = min(j0+PREDICT_TILE_SV,l);
+		int m = j1-j0;
+
+		for(ii=0;ii<n;ii++)
+			for(jj=0;jj<m;jj++)
+				tile[ii*PREDICT_TILE_SV+jj] = 0;
+		for(int k0=0;k0<d;k0+=PREDICT_TILE_DIM)
+		{
+			int len = min(k0+PREDICT_TILE_DIM,d)-k0;
+			for(ii=0;ii<n;ii++)
 			{
-				pairwise_prob[i][j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
-				pairwise_prob[j][i]=1-pairwise_prob[i][j];
-				k++;
+				const double *xi = &x[(size_t)ii*dim+k0];
+				double *t = &tile[ii*PREDICT_TILE_SV];
+				size_t offset = (size_t)j0*sv_dim+k0;
+				if(cm->sv_dense)
+					for(jj=0;jj<m;jj++,offset+=sv_dim)
+						t[jj] += Kernel::dot(xi,&cm->sv_dense[offset],len);
+				else if(cm->sv_float)
+					for(jj=0;jj<m;jj++,offset+=sv_dim)
+						t[jj] += dot_float(xi,&cm->sv_float[offset],len);
+				else
+				{
+					for(int k=0;k<len;k++)
+						x_scaled[k] = xi[k]*cm->sv_scale[k0+k];
+					for(jj=0;jj<m;jj++,offset+=sv_dim)
+						t[jj] += dot_int8(x_scaled,&cm->sv_int8[offset],len);
+				}
 			}
-		if (nr_class == 2)
+		}
+
+		for(ii=0;ii<n;ii++)
 		{
-			prob_estimates[0] = pairwise_prob[0][1];
-			prob_estimates[1] = pairwise_prob[1][0];
+			double *t = &tile[ii*PREDICT_TILE_SV];
+			switch(param.kernel_type)
+			{
+				case LINEAR:
+					break;
+				case POLY:
+					for(jj=0;jj<m;jj++)
+						t[jj] = powi(param.gamma*t[jj]+param.coef0,param.degree);
+					break;
+				case RBF:
+					for(jj=0;jj<m;jj++)
+						t[jj] = -param.gamma*(x_square[ii]+sv_square[j0+jj]-2*t[jj]);
+					exp_values(t,m);
+					break;
+				case SIGMOID:
+					for(jj=0;jj<m;jj++)
+						t[jj] = param.gamma*t[jj]+param.coef0;
+					tanh_values(t,m);
+					break;
+			}
+
+			double *dec = &dec_values[(size_t)ii*nr_dec];
+			for(jj=0;jj<m;jj++)
+			{
+				const int *dec_jj = &cm->sv_dec[(size_t)(j0+jj)*nr_coef];
+				for(int c=0;c<nr_coef;c++)
+					dec[dec_jj[c]] += model->sv_coef[c][j0+jj]*t[jj];
+			}
 		}
-		else
-			multiclass_probability(nr_class,pairwise_prob,prob_estimates);
+	}
+}
+
+static void predict_dense_tiles(const svm_model *model, const double *x, int n, int dim,
+				double *dec_values)
+{
+	const svm_compiled_model *cm = model->compiled;
+	int nr_dec = cm->nr_dec;
+	int i;
+
+	bool need_square = cm->sv_dense_square || cm->sv_square;
+
+	memset(dec_values,0,sizeof(double)*(size_t)n*nr_dec);
+
+SVM_OMP(omp parallel if(n > PREDICT_TILE_X))
+	{
+		double *tile = new double[PREDICT_TILE_X*PREDICT_TILE_SV];
+		double x_square[PREDICT_TILE_X];
+		double *x_scaled = cm->sv_int8 ? new double[PREDICT_TILE_DIM] : NULL;
+SVM_OMP(omp for schedule(dynamic))
+		for(int i0=0;i0<n;i0+=PREDICT_TILE_X)
+		{
+			int i1 = min(i0+PREDICT_TILE_X,n);
+			if(need_square)
+				for(int ii=i0;ii<i1;ii++)
+				{
+					const double *xi = &x[(size_t)ii*dim];
+					x_square[ii-i0] = Kernel::dot(xi,xi,dim);
+				}
+			predict_dense_tile(model,&x[(size_t)i0*dim],i1-i0,dim,x_square,tile,x_scaled,
+					   &dec_values[(size_t)i0*nr_dec]);
+		}
+		delete[] tile;
+		delete[] x_scaled;
+	}
+
+	for(i=0;i<n;i++)
+		for(int p=0;p<nr_dec;p++)
+			dec_values[(size_t)i*nr_dec+p] -= model->rho[p];
+}
+
+void svm_predict_dense(const svm_model *model, const double *x, int n, int dim,
+		       double *labels, double *dec_values, double *prob_estimates)
+{
+	int nr_class = model->nr_class;
+	int nr_dec = is_single_output(model) ? 1 : nr_class*(nr_class-1)/2;
+	bool probability = prob_estimates != NULL &&
+		(model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+		model->probA != NULL && model->probB != NULL;
+	bool sign_only = dec_values == NULL && !probability;
+	double *dec = dec_values ? dec_values : Malloc(double,(size_t)n*nr_dec);
+	SVM_PROBE3(predict__start,n,dim,model->l);
+
+	if(model->compiled && has_dense_sv(model->compiled) && !model->compiled->tree &&
+	   !(sign_only && model->compiled->sv_ordered))
+		predict_dense_tiles(model,x,n,dim,dec);
+	else
+	{
+SVM_OMP(omp parallel)
+		{
+			svm_node *node = Malloc(svm_node,dim+1);
+			double *work = Malloc(double,predict_work_size(model));
+SVM_OMP(omp for schedule(dynamic,16))
+			for(int i=0;i<n;i++)
+			{
+				const double *xi = &x[(size_t)i*dim];
+				int k = 0;
+				for(int j=0;j<dim;j++)
+					if(xi[j] != 0)
+					{
+						node[k].index = j+1;
+						node[k].value = xi[j];
+						++k;
+					}
+				node[k].index = -1;
+				predict_decision_values(model,node,&dec[(size_t)i*nr_dec],sign_only,work);
+			}
+			free(node);
+			free(work);
+		}
+	}
+
+	double *vote = Malloc(double,nr_class);
+	for(int i=0;i<n;i++)
+	{
+		if(probability)
+			predict_probability(model,&dec[(size_t)i*nr_dec],&prob_estimates[(size_t)i*nr_class]);
+		if(labels)
+			labels[i] = predict_label(model,&dec[(size_t)i*nr_dec],vote);
+	}
+	free(vote);
+
+	if(dec != dec_values)
+		free(dec);
+	SVM_PROBE1(predict__done,n);
+}
+
+//
+// Model compression
+//
+// Each decision function f = sum_k a_k*K(.,s_k) is replaced by its
+// projection f' onto the span of K(.,z) for a reduced set Z of its SVs. SVs
+// are added to Z in decreasing order of |a_k| until ||f-f'|| <= tolerance
+// in the kernel's feature space; an SV nearly dependent on Z (a duplicate
+// or a close neighbor of one in Z) is skipped, so its weight goes to Z. The
+// coefficients b of f' solve K_ZZ*b = K_ZS*a; a Cholesky factor L of K_ZZ
+// grows by one row per SV in Z, and with c = L^-1*K_ZS*a,
+// ||f-f'||^2 = a'*K_SS*a - c'*c. Since |f(x)-f'(x)| <= ||f-f'||*sqrt(K(x,x)),
+// the error bounds decision values for RBF, where K(x,x) = 1.
+//
+// K_SS is symmetric, so only its upper triangle is computed. It is kept for
+// the Cholesky steps if it fits in cache_size, and recomputed otherwise.
+// Z stops growing at max_sv SVs, or when the monitor is cancelled or out of
+// time; the error is then that of the SVs added so far.
+//
+
+// position of K_SS(i,j), i <= j, in the packed upper triangle of an n x n matrix
+static inline size_t packed_index(int n, int i, int j)
+{
+	return (size_t)i*(2*(size_t)n-i+1)/2+(j-i);
+}
+
+// replace coef (of decision function p) by the coefficients of its
+// projection; returns ||f-f'||. If stopped before a'*K_SS*a is known,
+// coef is left as the original coefficients and 0 is returned.
+static double compress_dec_function(const svm_model *model, int p, double tolerance, int max_sv,
+	const svm_monitor *monitor, double *coef)
+{
+	const svm_parameter& param = model->param;
+	svm_node * const *SV = model->SV;
+	int l = model->l;
+	int i, j, n = 0;
+	get_dec_coef(model,p,coef);
+
+	coef_order *order = Malloc(coef_order,l);
+	for(i=0;i<l;i++)
+		if(coef[i] != 0)
+		{
+			order[n].abs_coef = fabs(coef[i]);
+			order[n].index = i;
+			++n;
+		}
+	qsort(order,n,sizeof(coef_order),compare_coef_order);
+
+	double *K = NULL;
+	size_t nr_K = (size_t)n*(n+1)/2;
+	if(nr_K <= (size_t)(param.cache_size*(1<<20))/sizeof(double))
+		K = (double *)malloc(nr_K*sizeof(double));
+
+	// Ka[i] = (K_SS*a)_i for the SVs in that order, aKa = a'*K_SS*a
+	double *Ka = Malloc(double,n);
+	for(i=0;i<n;i++)
+		Ka[i] = 0;
+	for(i=0;i<n;i++)
+	{
+		if(is_training_stopped(monitor))
+		{
+			free(K);
+			free(Ka);
+			free(order);
+			return 0;
+		}
+		const svm_node *s = SV[order[i].index];
+		double a_i = coef[order[i].index];
+		double sum = 0;
+		for(j=i;j<n;j++)
+		{
+			double k_ij = Kernel::k_function(s,SV[order[j].index],param);
+			if(K != NULL)
+				K[packed_index(n,i,j)] = k_ij;
+			if(j == i)
+				sum += a_i*k_ij;
+			else
+			{
+				sum += coef[order[j].index]*k_ij;
+				Ka[j] += a_i*k_ij;
+			}
+		}
+		Ka[i] += sum;
+	}
+	double aKa = 0;
+	for(i=0;i<n;i++)
+		aKa += coef[order[i].index]*Ka[i];
+
+	// z holds positions in order, so that K_SS(z_q,i) = K[packed_index(n,z[q],i)]
+	int *z = Malloc(int,n);
+	double **L = Malloc(double *,n);
+	double *c = Malloc(double,n);
+	double *row = Malloc(double,n);
+	int nr_z = 0;
+	double error2 = aKa;
+	for(i=0;i<n && sqrt(max(error2,0.0)) > tolerance;i++)
+	{
+		if((max_sv > 0 && nr_z >= max_sv) || is_training_stopped(monitor))
+			break;
+		const svm_node *s = SV[order[i].index];
+		double K_ss = K != NULL ? K[packed_index(n,i,i)] : Kernel::k_function(s,s,param);
+		double d2 = K_ss;
+		for(int q=0;q<nr_z;q++)
+		{
+			double v = K != NULL ? K[packed_index(n,z[q],i)] : Kernel::k_function(SV[order[z[q]].index],s,param);
+			for(int r=0;r<q;r++)
+				v -= L[q][r]*row[r];
+			row[q] = v/L[q][q];
+			d2 -= row[q]*row[q];
+		}
+		if(d2 <= 1e-10*K_ss)
+			continue;
+
+		L[nr_z] = Malloc(double,nr_z+1);
+		double c_new = Ka[i];
+		for(int q=0;q<nr_z;q++)
+		{
+			L[nr_z][q] = row[q];
+			c_new -= row[q]*c[q];
+		}
+		L[nr_z][nr_z] = sqrt(d2);
+		c[nr_z] = c_new/L[nr_z][nr_z];
+		error2 -= c[nr_z]*c[nr_z];
+		z[nr_z++] = i;
+	}
+
+	// b = L'^-1*c
+	for(i=0;i<l;i++)
+		coef[i] = 0;
+	for(int q=nr_z-1;q>=0;q--)
+	{
+		double v = c[q];
+		for(int r=q+1;r<nr_z;r++)
+			v -= L[r][q]*row[r];
+		row[q] = v/L[q][q];
+		coef[order[z[q]].index] = row[q];
+	}
+
+	for(i=0;i<nr_z;i++)
+		free(L[i]);
+	free(L);
+	free(z);
+	free(c);
+	free(row);
+	free(Ka);
+	free(K);
+	free(order);
+	return sqrt(max(error2,0.0));
+}
+
+svm_model *svm_compress_model(const svm_model *model, double tolerance, int max_sv, double max_time, double *error)
+{
+	if(model->param.kernel_type == PRECOMPUTED || model->SV == NULL || model->sv_coef == NULL ||
+	   (!is_single_output(model) && model->nSV == NULL))
+		return NULL;
+
+	int l = model->l;
+	int nr_class = model->nr_class;
+	int nr_coef = is_single_output(model) ? 1 : nr_class-1;
+	int i, j, k;
+
+	// refit decision functions, writing back to rows of sv_coef
+	double **sv_coef = Malloc(double *,nr_coef);
+	for(i=0;i<nr_coef;i++)
+	{
+		sv_coef[i] = Malloc(double,l);
+		for(k=0;k<l;k++)
+			sv_coef[i][k] = 0;
+	}
+	// cancellation through the monitor of the model, with the deadline of max_time
+	svm_monitor local_monitor;
+	svm_monitor *monitor = model->param.monitor;
+	double saved_deadline = 0;
+	if(max_time > 0)
+	{
+		if(monitor == NULL)
+		{
+			svm_init_monitor(&local_monitor);
+			monitor = &local_monitor;
+		}
+		saved_deadline = monitor->deadline;
+		double deadline = wall_time() + max_time;
+		if(saved_deadline <= 0 || deadline < saved_deadline)
+			monitor->deadline = deadline;
+	}
 
-		int prob_max_idx = 0;
+	double *coef = Malloc(double,l);
+	*error = 0;
+	if(is_single_output(model))
+	{
+		*error = compress_dec_function(model,0,tolerance,max_sv,monitor,coef);
+		memcpy(sv_coef[0],coef,sizeof(double)*l);
+	}
+	else
+	{
+		int *start = Malloc(int,nr_class);
+		start[0] = 0;
 		for(i=1;i<nr_class;i++)
-			if(prob_estimates[i] > prob_estimates[prob_max_idx])
-				prob_max_idx = i;
+			start[i] = start[i-1]+model->nSV[i-1];
+		int p = 0;
 		for(i=0;i<nr_class;i++)
-			free(pairwise_prob[i]);
-		free(dec_values);
-		free(pairwise_prob);
-		return model->label[prob_max_idx];
+			for(j=i+1;j<nr_class;j++)
+			{
+				*error = max(*error,compress_dec_function(model,p,tolerance,max_sv,monitor,coef));
+				for(k=start[i];k<start[i]+model->nSV[i];k++)
+					sv_coef[j-1][k] = coef[k];
+				for(k=start[j];k<start[j]+model->nSV[j];k++)
+					sv_coef[i][k] = coef[k];
+				p++;
+			}
+		free(start);
 	}
-	else
-		return svm_predict(model, x);
+	free(coef);
+	if(max_time > 0)
+		monitor->deadline = saved_deadline;
+
+	// keep SVs with a nonzero coefficient in some decision function
+	bool *keep = Malloc(bool,l);
+	int new_l = 0;
+	size_t nr_node = 0;
+	for(k=0;k<l;k++)
+	{
+		keep[k] = false;
+		for(i=0;i<nr_coef;i++)
+			if(sv_coef[i][k] != 0)
+				keep[k] = true;
+		if(keep[k])
+		{
+			++new_l;
+			for(const svm_node *px = model->SV[k]; px->index != -1; ++px)
+				++nr_node;
+			++nr_node;
+		}
+	}
+
+	svm_model *new_model = Malloc(svm_model,1);
+	new_model->param = model->param;
+	new_model->param.monitor = NULL;
+	new_model->nr_class = nr_class;
+	new_model->l = new_l;
+	new_model->free_sv = 1;
+	new_model->compiled = NULL;
+	new_model->converged = model->converged;
+
+	int nr_dec = is_single_output(model) ? 1 : nr_class*(nr_class-1)/2;
+	new_model->rho = Malloc(double,nr_dec);
+	memcpy(new_model->rho,model->rho,sizeof(double)*nr_dec);
+	new_model->probA = NULL;
+	new_model->probB = NULL;
+	if(model->probA)
+	{
+		new_model->probA = Malloc(double,nr_dec);
+		memcpy(new_model->probA,model->probA,sizeof(double)*nr_dec);
+	}
+	if(model->probB)
+	{
+		new_model->probB = Malloc(double,nr_dec);
+		memcpy(new_model->probB,model->probB,sizeof(double)*nr_dec);
+	}
+	new_model->label = NULL;
+	if(model->label)
+	{
+		new_model->label = Malloc(int,nr_class);
+		memcpy(new_model->label,model->label,sizeof(int)*nr_class);
+	}
+	new_model->nSV = NULL;
+	if(model->nSV)
+	{
+		new_model->nSV = Malloc(int,nr_class);
+		k = 0;
+		for(i=0;i<nr_class;i++)
+		{
+			new_model->nSV[i] = 0;
+			for(j=0;j<model->nSV[i];j++,k++)
+				if(keep[k])
+					++new_model->nSV[i];
+		}
+	}
+
+	new_model->SV = Malloc(svm_node *,new_l);
+	new_model->sv_coef = Malloc(double *,nr_coef);
+	for(i=0;i<nr_coef;i++)
+		new_model->sv_coef[i] = Malloc(double,new_l);
+	new_model->sv_indices = model->sv_indices ? Malloc(int,new_l) : NULL;
+	svm_node *x_space = Malloc(svm_node,nr_node > 0 ? nr_node : 1);
+	j = 0;
+	for(k=0;k<l;k++)
+		if(keep[k])
+		{
+			new_model->SV[j] = x_space;
+			const svm_node *px = model->SV[k];
+			while(px->index != -1)
+				*x_space++ = *px++;
+			*x_space++ = *px;
+			for(i=0;i<nr_coef;i++)
+				new_model->sv_coef[i][j] = sv_coef[i][k];
+			if(new_model->sv_indices)
+				new_model->sv_indices[j] = model->sv_indices[k];
+			++j;
+		}
+	if(new_l == 0)
+		free(x_space);
+
+	for(i=0;i<nr_coef;i++)
+		free(sv_coef[i]);
+	free(sv_coef);
+	free(keep);
+
+	svm_compile_model(new_model,NULL);
+	return new_model;
 }
 
 static const char *svm_type_table[] =
@@ -2898,12 +5618,15 @@ svm_model *svm_load_model(const char *model_file_name)
 	// read parameters
 
 	svm_model *model = Malloc(svm_model,1);
+	model->param.monitor = NULL;
+	model->converged = 1;
 	model->rho = NULL;
 	model->probA = NULL;
 	model->probB = NULL;
 	model->sv_indices = NULL;
 	model->label = NULL;
 	model->nSV = NULL;
+	model->compiled = NULL;
 
 	// read header
 	if (!read_model_header(fp, model))
@@ -2989,6 +5712,7 @@ svm_model *svm_load_model(const char *model_file_name)
 		return NULL;
 
 	model->free_sv = 1;	// XXX
+	svm_compile_model(model,NULL);
 	return model;
 }
 
@@ -3025,6 +5749,8 @@ void svm_free_model_content(svm_model* model_ptr)
 
 	free(model_ptr->nSV);
 	model_ptr->nSV = NULL;
+
+	svm_free_compiled_model(model_ptr);
 }
 
 void svm_free_and_destroy_model(svm_model** model_ptr_ptr)
@@ -3080,6 +5806,12 @@ const char *svm_check_parameter(const svm_problem *prob, const svm_parameter *pa
 	if(param->eps <= 0)
 		return "eps <= 0";
 
+	if(param->max_iter < 0)
+		return "max_iter < 0";
+
+	if(param->max_time < 0)
+		return "max_time < 0";
+
 	if(svm_type == C_SVC ||
 	   svm_type == EPSILON_SVR ||
 	   svm_type == NU_SVR)
@@ -3,16 +3,33 @@
 
 #define LIBSVM_VERSION 324
 
+/* progress of svm_monitor is read by other threads while training writes it */
+#ifdef __cplusplus
+#include <atomic>
+typedef std::atomic<int> svm_atomic_int;
+typedef std::atomic<double> svm_atomic_double;
+#else
+#include <stdatomic.h>
+typedef _Atomic int svm_atomic_int;
+typedef _Atomic double svm_atomic_double;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int libsvm_version;
 
+#ifdef LIBSVM_SINGLE_PRECISION
+typedef float svm_value;	/* halves the memory of samples and SVs */
+#else
+typedef double svm_value;
+#endif
+
 struct svm_node
 {
 	int index;
-	double value;
+	svm_value value;
 };
 
 struct svm_problem
@@ -24,6 +41,77 @@ struct svm_problem
 
 enum { C_SVC, NU_SVC, ONE_CLASS, EPSILON_SVR, NU_SVR };	/* svm_type */
 enum { LINEAR, POLY, RBF, SIGMOID, PRECOMPUTED }; /* kernel_type */
+enum { SV_FLOAT64, SV_FLOAT32, SV_INT8 };	/* sv_precision */
+
+//
+// svm_telemetry: state of the solver passed to the telemetry callback of svm_monitor
+//
+struct svm_telemetry
+{
+	int subproblem;	/* index of the one-vs-one subproblem (multi-class only) */
+	int iter;	/* iterations done */
+	double obj;	/* objective value */
+	double kkt_violation;	/* maximal violation of the KKT conditions (Gmax+Gmax2) */
+	int active_size;	/* number of variables not shrunk */
+	int nr_shrink;	/* number of times shrinking is checked */
+	int nr_reconstruct;	/* number of times the whole gradient is reconstructed */
+	int finished;	/* 1 for the last sample of the solver */
+};
+
+//
+// svm_kernel_stats: kernel cache and kernel evaluation counters of training,
+// accumulated over all solvers (including those for probability estimates)
+//
+struct svm_kernel_stats
+{
+	long long cache_hits;	/* columns found in the kernel cache */
+	long long cache_misses;	/* columns computed, or extended, into the kernel cache */
+	long long cache_evictions;	/* columns freed from the kernel cache */
+	long long cache_bytes;	/* largest memory of the kernel cache (or of the whole kernel matrix) in use */
+	long long train_kernel_evaluations;	/* kernel values computed by the solvers */
+	long long predict_kernel_evaluations;	/* kernel values computed to predict samples in training */
+	double fill_time;	/* seconds spent computing kernel columns and matrices */
+};
+
+//
+// svm_timing: seconds spent in the phases of the outermost svm_train or
+// svm_cross_validation, set by them if timing of svm_monitor is not NULL
+//
+struct svm_timing
+{
+	double group_classes;	/* grouping samples of the same class */
+	double probability;	/* cross validation for probability estimates */
+	double solve;	/* solvers of the decision functions */
+	double assemble;	/* building and compiling the model */
+	double train;	/* training the models of the folds (svm_cross_validation) */
+	double predict;	/* predicting the samples of the folds (svm_cross_validation) */
+	int nr_pair;	/* number of one-vs-one pairs of the arrays below (classification) */
+	double *pair_probability;	/* per pair, allocated by svm_train and freed by svm_free_timing */
+	double *pair_solve;
+};
+
+//
+// svm_monitor: progress of training, written by the solver while it runs,
+// and a flag that stops training when set by another thread. Initialize it
+// with svm_init_monitor; the atomic fields are not copied by assignment.
+//
+struct svm_monitor
+{
+	svm_atomic_int cancel;	/* set to nonzero to stop training */
+	svm_atomic_int iter;	/* iterations of the current subproblem */
+	svm_atomic_double obj;	/* objective value of the current subproblem */
+	svm_atomic_int active_size;	/* number of variables not shrunk */
+	svm_atomic_int subproblem;	/* index of the current one-vs-one subproblem (multi-class only) */
+	svm_atomic_int nr_subproblem;	/* number of one-vs-one subproblems (multi-class only) */
+	int has_rng;	/* nonzero to draw the random numbers of training from rng instead of rand() */
+	unsigned long long rng;	/* state of the random numbers of this training, seeded by the caller */
+	double deadline;	/* set by svm_train and svm_cross_validation from max_time */
+	int telemetry_interval;	/* call telemetry every telemetry_interval iterations and at the end of each solver */
+	void (*telemetry)(const struct svm_telemetry *, void *);	/* NULL for no telemetry */
+	void *telemetry_data;	/* passed to telemetry */
+	struct svm_kernel_stats kernel_stats;	/* updated by training */
+	struct svm_timing *timing;	/* NULL for no timing */
+};
 
 struct svm_parameter
 {
@@ -44,6 +132,9 @@ struct svm_parameter
 	double p;	/* for EPSILON_SVR */
 	int shrinking;	/* use the shrinking heuristics */
 	int probability; /* do probability estimates */
+	int max_iter;	/* maximal number of iterations of each solver, 0 for the default */
+	double max_time;	/* time budget of training in seconds, 0 for no limit */
+	struct svm_monitor *monitor;	/* progress and cancellation of training, or NULL */
 };
 
 //
@@ -69,6 +160,9 @@ struct svm_model
 	/* XXX */
 	int free_sv;		/* 1 if svm_model is created by svm_load_model*/
 				/* 0 if svm_model is created by svm_train */
+	int converged;		/* 0 if training stopped at max_iter or max_time, or was cancelled */
+
+	struct svm_compiled_model *compiled;	/* data for fast prediction, built by svm_compile_model (NULL if none) */
 };
 
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
@@ -85,16 +179,64 @@ int svm_get_nr_sv(const struct svm_model *model);
 double svm_get_svr_probability(const struct svm_model *model);
 
 double svm_predict_values(const struct svm_model *model, const struct svm_node *x, double* dec_values);
+/* svm_predict_values and svm_predict without allocating memory: scratch has */
+/* svm_predict_scratch_size(model) doubles and is not shared by concurrent calls */
+long svm_predict_scratch_size(const struct svm_model *model);
+double svm_predict_values_scratch(const struct svm_model *model, const struct svm_node *x, double *dec_values, double *scratch);
+double svm_predict_scratch(const struct svm_model *model, const struct svm_node *x, double *scratch);
 double svm_predict(const struct svm_model *model, const struct svm_node *x);
 double svm_predict_probability(const struct svm_model *model, const struct svm_node *x, double* prob_estimates);
 
+/* n dense samples x[i*dim+j]; outputs are n rows, any of them may be NULL; */
+/* labels are those of svm_predict, prob_estimates are set only for models with probability information */
+void svm_predict_dense(const struct svm_model *model, const double *x, int n, int dim,
+		       double *labels, double *dec_values, double *prob_estimates);
+
+struct svm_compile_parameter
+{
+	int early_termination;	/* for binary models with RBF or sigmoid kernel, let svm_predict stop */
+				/* summing kernel values once the sign of the decision value is known */
+	double tree_tolerance;	/* for RBF models, skip SVs with kernel values below this found */
+				/* by a ball tree over SVs (0 to compute all kernel values) */
+	int sv_precision;	/* values of the dense SVs for svm_predict_dense */
+};
+
+struct svm_compiled_model_info
+{
+	int weight_vector;	/* 1 if decision functions are folded into weight vectors */
+	int polynomial_map;	/* 1 if decision functions are explicit polynomial maps */
+	int dense_sv;		/* 1 if SVs are stored densely for svm_predict_dense */
+	int early_termination;	/* 1 if svm_predict may stop early */
+	int tree_nodes;		/* number of nodes of the ball tree over SVs, 0 if none */
+	double error_bound;	/* bound of the error of decision values by approximations */
+	int sv_precision;	/* values of the dense SVs */
+	long sv_bytes;		/* memory of the dense SVs */
+	double quantization_error;	/* largest error of a dense SV value */
+	long sv_node_bytes;	/* memory of the svm_node rows of the SVs, 0 if they are freed */
+};
+
+void svm_compile_model(struct svm_model *model, const struct svm_compile_parameter *cparam);
+void svm_get_compiled_model_info(const struct svm_model *model, struct svm_compiled_model_info *info);
+void svm_free_compiled_model(struct svm_model *model);
+/* 0 if prediction with the compiled model does not read model->SV, so that the caller may free the SV rows */
+int svm_compiled_model_needs_sv(const struct svm_model *model);
+
+/* smaller model whose decision functions are within tolerance of those of model in the kernel's */
+/* feature space (the achieved distance is stored to error); NULL for precomputed kernels. */
+/* Each decision function keeps at most max_sv SVs (0 for no limit), and compression stops after */
+/* max_time seconds (0 for no limit) or when model->param.monitor is cancelled. */
+struct svm_model *svm_compress_model(const struct svm_model *model, double tolerance, int max_sv, double max_time, double *error);
+
 void svm_free_model_content(struct svm_model *model_ptr);
 void svm_free_and_destroy_model(struct svm_model **model_ptr_ptr);
 void svm_destroy_param(struct svm_parameter *param);
+void svm_free_timing(struct svm_timing *timing);
+void svm_init_monitor(struct svm_monitor *monitor);
 
 const char *svm_check_parameter(const struct svm_problem *prob, const struct svm_parameter *param);
 int svm_check_probability_model(const struct svm_model *model);
 
+/* the print function is set for the calling thread only */
 void svm_set_print_string_function(void (*print_func)(const char *));
 
 #ifdef __cplusplus
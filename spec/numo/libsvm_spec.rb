@@ -112,6 +112,135 @@ RSpec.describe Numo::Libsvm do
       expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
     end
 
+    it 'stores predicted labels, decision values, and probabilities in given arrays', aggregate_failures: true do
+      pr = Numo::DFloat.zeros(n_test_samples)
+      df = Numo::DFloat.zeros(n_test_samples, n_classes * (n_classes - 1) / 2)
+      pb = Numo::DFloat.zeros(n_test_samples, n_classes)
+      expect(Numo::Libsvm.predict(x_test, c_svc_param, c_svc_model, out: pr)).to equal(pr)
+      expect(Numo::Libsvm.decision_function(x_test, c_svc_param, c_svc_model, out: df)).to equal(df)
+      expect(Numo::Libsvm.predict_proba(x_test, c_svc_param, c_svc_model, out: pb)).to equal(pb)
+      expect(pr).to eq(Numo::Libsvm.predict(x_test, c_svc_param, c_svc_model))
+      expect(df).to eq(Numo::Libsvm.decision_function(x_test, c_svc_param, c_svc_model))
+      expect(pb).to eq(Numo::Libsvm.predict_proba(x_test, c_svc_param, c_svc_model))
+    end
+
+    it 'predicts labels, decision values, and probabilities at once with C-SVC', aggregate_failures: true do
+      pr, df, pb = Numo::Libsvm.predict_all(x_test, c_svc_param, c_svc_model)
+      expect(pr).to eq(Numo::Libsvm.predict(x_test, c_svc_param, c_svc_model))
+      expect(df).to eq(Numo::Libsvm.decision_function(x_test, c_svc_param, c_svc_model))
+      expect(pb).to eq(Numo::Libsvm.predict_proba(x_test, c_svc_param, c_svc_model))
+    end
+
+    it 'trains C-SVC with single precision samples' do
+      x_sf = Numo::SFloat.cast(x)
+      expect(Numo::Libsvm.train(x_sf, y, c_svc_param)).to eq(Numo::Libsvm.train(Numo::DFloat.cast(x_sf), y, c_svc_param))
+    end
+
+    it 'trains C-SVC with samples that are views' do
+      expect(Numo::Libsvm.train(x.transpose.dup.transpose, y, c_svc_param)).to eq(c_svc_model)
+    end
+
+    it 'predicts labels of samples that are views or of other types', aggregate_failures: true do
+      pr = Numo::Libsvm.predict(x_test, c_svc_param, c_svc_model)
+      x_sf = Numo::SFloat.cast(x_test)
+      expect(Numo::Libsvm.predict(x_test.transpose.dup.transpose, c_svc_param, c_svc_model)).to eq(pr)
+      expect(Numo::Libsvm.predict(x_test[1..-1, true], c_svc_param, c_svc_model)).to eq(pr[1..-1])
+      expect(Numo::Libsvm.predict(x_sf, c_svc_param, c_svc_model))
+        .to eq(Numo::Libsvm.predict(Numo::DFloat.cast(x_sf), c_svc_param, c_svc_model))
+    end
+
+    it 'returns a non-converged feasible model when training stops at max_iter', aggregate_failures: true do
+      model = Numo::Libsvm.train(x, y, c_svc_param.merge(max_iter: 1, probability: false))
+      expect(c_svc_model[:converged]).to be_truthy
+      expect(model[:converged]).to be_falsy
+      expect((model[:sv_coef].abs <= c_svc_param[:C]).all?).to be_truthy
+    end
+
+    it 'samples the solver state during training', aggregate_failures: true do
+      samples = []
+      param = c_svc_param.merge(probability: false, telemetry_interval: 10, telemetry_callback: ->(t) { samples << t })
+      model = Numo::Libsvm.train(x, y, param)
+      finished = model[:telemetry].select { |t| t[:finished] }
+      expect(model[:telemetry]).to eq(samples)
+      expect(finished.map { |t| t[:subproblem] }).to eq([0, 1, 2])
+      expect(finished.map { |t| t[:kkt_violation] }).to all(be < 1e-3)
+      expect(model.reject { |k, _v| k == :telemetry }).to eq(Numo::Libsvm.train(x, y, c_svc_param.merge(probability: false)))
+    end
+
+    it 'samples only the solvers of the decision functions when training with probability estimates' do
+      model = Numo::Libsvm.train(x, y, c_svc_param.merge(random_seed: 1, telemetry_interval: 10))
+      expect(model[:telemetry].select { |t| t[:finished] }.map { |t| t[:subproblem] }).to eq([0, 1, 2])
+    end
+
+    it 'stops training with the error raised by the telemetry callback' do
+      param = c_svc_param.merge(telemetry_interval: 1, telemetry_callback: ->(_t) { raise 'stop' })
+      expect { Numo::Libsvm.train(x, y, param) }.to raise_error(RuntimeError, 'stop')
+    end
+
+    it 'counts kernel cache hits and kernel evaluations during training', aggregate_failures: true do
+      param = c_svc_param.merge(random_seed: 1)
+      model = Numo::Libsvm.train(x, y, param.merge(kernel_stats: true))
+      stats = model[:kernel_stats]
+      expect(stats.keys).to eq(%i[cache_hits cache_misses cache_evictions cache_bytes train_kernel_evaluations
+                                  predict_kernel_evaluations fill_time])
+      expect(stats[:train_kernel_evaluations]).to be_positive
+      expect(stats[:predict_kernel_evaluations]).to be_positive
+      expect(stats[:cache_bytes]).to be_positive
+      expect(model.reject { |k, _v| k == :kernel_stats }).to eq(Numo::Libsvm.train(x, y, param))
+    end
+
+    it 'returns the seconds spent in each phase of training and prediction', aggregate_failures: true do
+      model = Numo::Libsvm.train(x, y, c_svc_param.merge(timing: true))
+      expect(model[:timing].keys).to eq(%i[convert_dataset group_classes probability solve assemble convert_model pairs])
+      expect(model[:timing][:pairs].size).to eq(n_classes * (n_classes - 1) / 2)
+      expect(model[:timing][:solve]).to be_within(1e-8).of(model[:timing][:pairs].sum { |t| t[:solve] })
+      timing = {}
+      Numo::Libsvm.predict(x_test, c_svc_param, model, timing: timing)
+      expect(timing.keys).to eq(%i[convert_model compile convert_samples predict])
+      expect(timing.values).to all(be >= 0)
+      timing = {}
+      Numo::Libsvm.cv(x, y, c_svc_param, 5, timing: timing)
+      expect(timing.keys).to eq(%i[convert_dataset group_classes train predict])
+    end
+
+    it 'trains C-SVC on a native thread', aggregate_failures: true do
+      param = c_svc_param.merge(probability: false)
+      job = Numo::Libsvm.train_async(x, y, param)
+      expect(job.progress.keys).to eq(%i[iter obj active_size subproblem nr_subproblem])
+      expect(job.wait).to eq(Numo::Libsvm.train(x, y, param))
+      expect(job.done?).to be_truthy
+      expect(job.cancelled?).to be_falsy
+      expect(job.progress[:nr_subproblem]).to eq(n_classes * (n_classes - 1) / 2)
+    end
+
+    it 'trains the same model with probability estimates on a native thread given the random seed' do
+      param = c_svc_param.merge(random_seed: 1)
+      jobs = Array.new(2) { Numo::Libsvm.train_async(x, y, param) }
+      expect(jobs.map(&:wait)).to all(eq(Numo::Libsvm.train(x, y, param)))
+    end
+
+    it 'returns a feasible model of the cancelled training', aggregate_failures: true do
+      job = Numo::Libsvm.train_async(x, y, c_svc_param.merge(probability: false)).cancel
+      model = job.wait
+      expect(job.cancelled?).to be_truthy
+      expect(model[:nr_class]).to eq(n_classes)
+      expect((model[:sv_coef].abs <= c_svc_param[:C]).all?).to be_truthy
+    end
+
+    it 'predicts a sample given as an array, a Ruby array, or a hash with compiled model', aggregate_failures: true do
+      compiled = Numo::Libsvm::CompiledModel.new(c_svc_param, c_svc_model)
+      pr = Numo::Libsvm.predict(x_test, c_svc_param, c_svc_model)
+      df = Numo::Libsvm.decision_function(x_test, c_svc_param, c_svc_model)
+      n_test_samples.times do |n|
+        sample = x_test[n, true]
+        expect(compiled.predict(sample)).to eq(pr[n])
+        expect(compiled.predict(sample.to_a)).to eq(pr[n])
+        expect(compiled.predict(sample.to_a.each_with_index.to_h { |v, j| [j, v] })).to eq(pr[n])
+        expect((Numo::DFloat[*compiled.decision_function(sample)] - df[n, true]).abs.max).to be < 1e-8
+      end
+      expect(compiled.info).to eq(Numo::Libsvm.compiled_model_info(c_svc_param, c_svc_model))
+    end
+
     context 'when given training data  that contain all zero value feature' do
       let(:n_train_samples) { dataset[0].shape[0] }
       let(:n_test_samples) { dataset[2].shape[0] }
@@ -167,6 +296,12 @@ RSpec.describe Numo::Libsvm do
       pr = Numo::Libsvm.cv(x, y, svr_param, 5)
       expect(r2_score(y, pr)).to be >= 0.1
     end
+
+    it 'estimates a finite sigma of the probability model when training runs out of max_time', aggregate_failures: true do
+      model = Numo::Libsvm.train(x, y, svr_param.merge(probability: true, max_time: 1e-9))
+      expect(model[:converged]).to be_falsy
+      expect(model[:probA].isfinite.all?).to be_truthy
+    end
   end
 
   describe 'distribution estimation' do
@@ -201,6 +336,54 @@ RSpec.describe Numo::Libsvm do
       expect(pr.shape[1]).to be_nil
       expect(accuracy(y_neg, pr)).to be >= 0.9
     end
+
+    it 'calculates decision function within the error bound with ball tree', aggregate_failures: true do
+      param = oc_svm_param.merge(tree_tolerance: 1e-4)
+      info = Numo::Libsvm.compiled_model_info(param, oc_svm_model)
+      df = Numo::Libsvm.decision_function(x_neg, param, oc_svm_model)
+      expect(info[:tree_nodes]).to be_positive
+      expect((df - Numo::Libsvm.decision_function(x_neg, oc_svm_param, oc_svm_model)).abs.max).to be <= info[:error_bound]
+    end
+
+    it 'predicts the same labels with early termination' do
+      pr = Numo::Libsvm.predict(x_neg, oc_svm_param.merge(early_termination: true), oc_svm_model)
+      expect(pr).to eq(Numo::Libsvm.predict(x_neg, oc_svm_param, oc_svm_model))
+    end
+
+    it 'calculates decision function with single precision support vectors', aggregate_failures: true do
+      param = oc_svm_param.merge(sv_precision: Numo::Libsvm::SvPrecision::FLOAT32)
+      info = Numo::Libsvm.compiled_model_info(param, oc_svm_model)
+      df = Numo::Libsvm.decision_function(x_neg, param, oc_svm_model)
+      expect(info[:sv_bytes]).to eq(Numo::Libsvm.compiled_model_info(oc_svm_param, oc_svm_model)[:sv_bytes] / 2)
+      expect((df - Numo::Libsvm.decision_function(x_neg, oc_svm_param, oc_svm_model)).abs.max).to be < 1e-4
+    end
+
+    it 'predicts labels with 8-bit integer support vectors', aggregate_failures: true do
+      param = oc_svm_param.merge(sv_precision: Numo::Libsvm::SvPrecision::INT8)
+      info = Numo::Libsvm.compiled_model_info(param, oc_svm_model)
+      pr = Numo::Libsvm.predict(x_neg, param, oc_svm_model)
+      expect(info[:sv_bytes]).to eq(Numo::Libsvm.compiled_model_info(oc_svm_param, oc_svm_model)[:sv_bytes] / 8)
+      expect(accuracy(y_neg, pr)).to be_within(0.01).of(accuracy(y_neg, Numo::Libsvm.predict(x_neg, oc_svm_param, oc_svm_model)))
+      compiled = Numo::Libsvm::CompiledModel.new(param, oc_svm_model)
+      expect(compiled.info[:sv_node_bytes]).to eq(0)
+      expect(info[:sv_node_bytes]).to be_positive
+      expect(Numo::DFloat[*Array.new(n_test_samples) { |n| compiled.predict(x_neg[n, true]) }]).to eq(pr)
+    end
+
+    it 'compresses model within the tolerance', aggregate_failures: true do
+      model, info = Numo::Libsvm.compress_model(oc_svm_param, oc_svm_model, 1e-2)
+      df = Numo::Libsvm.decision_function(x_neg, oc_svm_param, model)
+      expect(model[:l]).to eq(info[:l])
+      expect(info[:l]).to be <= oc_svm_model[:l]
+      expect(info[:error]).to be <= 1e-2
+      expect((df - Numo::Libsvm.decision_function(x_neg, oc_svm_param, oc_svm_model)).abs.max).to be <= info[:error] + 1e-8
+    end
+
+    it 'compresses model into at most max_sv support vectors', aggregate_failures: true do
+      model, info = Numo::Libsvm.compress_model(oc_svm_param, oc_svm_model, 0.0, max_sv: 5)
+      expect(model[:l]).to be <= 5
+      expect(info[:error]).to be_positive
+    end
   end
 
   describe 'errors' do
@@ -262,6 +445,10 @@ RSpec.describe Numo::Libsvm do
       it 'raises ArgumentError when given non two-dimensional array as sample array' do
         expect { described_class.predict(Numo::DFloat.new(3, 2, 2).rand, svm_param, svm_model) }.to raise_error(ArgumentError, 'Expect samples to be 2-D array.')
       end
+
+      it 'raises ArgumentError when given output array of wrong shape' do
+        expect { described_class.predict(x, svm_param, svm_model, out: Numo::DFloat.zeros(x.shape[0] + 1)) }.to raise_error(ArgumentError, 'Expect output array to be a writable contiguous Numo::DFloat of shape [n_samples].')
+      end
     end
 
     describe '#decision_function' do
@@ -276,6 +463,20 @@ RSpec.describe Numo::Libsvm do
       end
     end
 
+    describe '#predict_all' do
+      it 'raises ArgumentError when given non two-dimensional array as sample array' do
+        expect { described_class.predict_all(Numo::DFloat.new(3, 2, 2).rand, svm_param, svm_model) }.to raise_error(ArgumentError, 'Expect samples to be 2-D array.')
+      end
+    end
+
+    describe 'CompiledModel#predict' do
+      it 'raises ArgumentError when given a non-1-D array or a negative feature index', aggregate_failures: true do
+        compiled = Numo::Libsvm::CompiledModel.new(svm_param, svm_model)
+        expect { compiled.predict(Numo::DFloat.new(3, 2).rand) }.to raise_error(ArgumentError, 'Expect sample to be 1-D array.')
+        expect { compiled.predict({ -1 => 1.0 }) }.to raise_error(ArgumentError, 'Expect feature indices to be non-negative integers.')
+      end
+    end
+
     describe '#load_svm_model' do
       it 'raises IOError when failed load file' do
         expect { described_class.load_svm_model('foo') }.to raise_error(IOError, "Failed to load file 'foo'")